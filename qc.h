@@ -56,6 +56,9 @@ enum QC_ERROR_T {
         QCE_ARRAY_INITIALIZER,
         QCE_INSANE_SHIFT,
         QCE_ARRAY_BOUNDS,
+        QCE_BAD_FREE,
+        QCE_NO_MEMBER,
+        QCE_CONST_ASSIGN,
         QCE_NERRS,
 };
 
@@ -67,6 +70,8 @@ enum QC_TOKENS {
 #define QC_FLTFLG       0x1000
 #define QC_STATIC       0x2000
 #define QC_VDFLG        0x4000 /* Additional flag for void, for faster checks */
+#define QC_STFLG        0x8000 /* Ditto for struct */
+#define QC_CONST        0x0080 /* `const', see qc_get_type() */
 
         /* Types */
         QC_CHAR = 1,
@@ -75,6 +80,7 @@ enum QC_TOKENS {
         QC_DBL,
         QC_FLT,
         QC_VOID,
+        QC_STRUCT,
 
         /* Keywords */
         QC_IF,
@@ -134,6 +140,8 @@ enum QC_TOKENS {
         QC_SEMI,        /* `;' */
         QC_COMMA,       /* `,' */
         QC_COLON,       /* ':' */
+        QC_DOT,         /* `.' */
+        QC_ARROW,       /* `->' */
 
         QC_MULTOK,      /* `*' */
         QC_DIVTOK,      /* `/' */
@@ -163,25 +171,25 @@ enum QC_TOKENS {
  *
  * This token is encoded as follows:
  *
- * Bits 0 to 7 contain the `enum QC_TOKEN' description of the token,
- * or zero if it is not a keyword.
- *
- * Bits 16 to 24 contain the `enum TOK_TYPES' description of the
- * token. use the QC_TOKEN_TYPE() macro to decode this, QC_TOKEN_CLRTYPE()
- * macro to clear this in a variable, and the QC_TOKEN_MKTYPE() macro to
- * encode this.
+ * Bits 0 to 6 contain the `enum QC_TOKEN' description of the token,
+ * or zero if it is not a keyword. Bit 7 is QC_CONST, which is only set
+ * in the `const' keyword and in types returned by qc_get_type().
  *
  * Bits 8 to 15 contain additional flags for determining if the token
  * is a data type, a pointer, and argument, etc. Use QC_ISPTR(),
  * QC_ISARG(), QC_ISTYPE() macros to determine this.
  *
+ * Bits 16 to 31 are zero, except for a struct type, where they hold
+ * which struct it is. Use QC_STRUCTID() to decode this.
+ *
  * The flags are also used with the other enumerations. Use QC_TYPEOF()
  * to get the data type of a token; macros QC_INTPTR, etc., can be used
  * in the same was as QC_INT for checking data types.
  */
-typedef unsigned short qctoken_t;
+typedef unsigned int qctoken_t;
 
 #define QC_TOK_MASK             (0x7FU)
+#define QC_STRUCT_SHIFT         16
 
 /*
  * Macros to encode/decode an qctoken_t variable. See comments to
@@ -190,7 +198,8 @@ typedef unsigned short qctoken_t;
 
 /* Data type of token `tk', or zero if token is not a data type */
 #define QC_TYPEOF(tk) \
-        ((tk) & (QC_TOK_MASK | QC_PTR | QC_VDFLG))
+        ((tk) & (QC_TOK_MASK | QC_PTR | QC_VDFLG | QC_STFLG \
+                 | (~0U << QC_STRUCT_SHIFT)))
 
 /* True if token `tk' is a data type */
 #define QC_ISTYPE(tk) \
@@ -209,14 +218,22 @@ typedef unsigned short qctoken_t;
 #define QC_ISFLT(tk) \
         (((tk) & QC_FLTFLG) != 0)
 
-/* True if token `tk' is neither floating point nor pointer */
+/* True if token `tk' is neither floating point, pointer nor struct */
 #define QC_ISINT(tk) \
-        (((tk) & (QC_FLTFLG | QC_PTR | QC_VDFLG)) == 0)
+        (((tk) & (QC_FLTFLG | QC_PTR | QC_VDFLG | QC_STFLG)) == 0)
 
 /* True if token `tk' is void and not a pointer */
 #define QC_ISVOID(tk) \
         (((tk) & (QC_VDFLG | QC_PTR)) == QC_VDFLG)
 
+/* True if token `tk' is a struct and not a pointer */
+#define QC_ISSTRUCT(tk) \
+        (((tk) & (QC_STFLG | QC_PTR)) == QC_STFLG)
+
+/* Which struct token `tk' is, if it is a struct or a pointer to one */
+#define QC_STRUCTID(tk) \
+        ((unsigned int)(tk) >> QC_STRUCT_SHIFT)
+
 #define QC_ISSIGNED(tk) \
         (((tk) & QC_UNSIGNED) == 0)
 
@@ -231,6 +248,9 @@ typedef unsigned short qctoken_t;
 /* Determine if a function or variable was declared `static'. */
 #define QC_ISSTATIC(tk) (((tk) & QC_STATIC) != 0)
 
+/* Ditto `const' */
+#define QC_ISCONST(tk) (((tk) & QC_CONST) != 0)
+
 /**
  * @brief Type for calculated has values.
  */
@@ -277,30 +297,43 @@ typedef struct Atom {
 /* XXX: Lots of this can be private data */
 /**
  * typedef Variable - Variable descriptor.
- * @v_aidx: Index in its array (usu. 0)
- * @v_asize: Array size (usu. 1)
- * @v_array: Array pointer for global variables. Local variable arrays
- *         will be pushed onto the stack (to spare a flood of malloc and
- *         free calls during program run time); this will point to NULL
- *         if the variable is local, or if the variable is not an
- *         array.
- * @v_hash: Hash number
- * @v_next: Next in hash table collision list.
+ * @v_datum: Value and type
+ * @v_array: Storage for an array's elements, or NULL if the variable is
+ *         not an array. The elements are packed by their declared type
+ *         (which is the type of the Variable), eg one byte per element
+ *         for a `char' array. Global arrays are allocated from their
+ *         Namespace's arena. Local arrays are allocated from a data
+ *         stack that is reset when the function returns (to spare a
+ *         flood of malloc and free calls during program run time),
+ *         unless they are too big for it; then they are calloc'd, and
+ *         freed when the function returns.
+ * @v_asize: Array size (usu. 1). For an array of more than one
+ *         dimension, this is the total number of elements.
+ * @v_flag: QC_VFLAG_* flags
+ * @v_ndim: Number of dimensions of an array declared with more than one,
+ *         eg two for `int m[3][4]'; else zero. Its sizes are kept in
+ *         front of @v_array (see QC_ARRAY_DIMS()), and its elements are
+ *         stored row by row, as one flat array.
  *
  * The variable's Atom struct is different in that once its
  * type is declared, it will not change. assign_var() will
  * cast the value of its Atom parameter (without side effects) before
- * assigning that value to a variable.
+ * assigning that value to a variable. For an array, only its type is
+ * used.
+ *
+ * This is only the part of a variable that the parser uses once it has
+ * the variable's address. The name, which is needed only to look the
+ * variable up, is kept in a separate table: next to the local variable
+ * stack for locals, and next to the storage for globals and statics.
+ * That way the values are packed together, and a name search does not
+ * drag them through the cache. See `make sizes'.
  */
 typedef struct Variable {
-        char v_name[ID_LEN + 1];
-        unsigned char v_flag;
-        unsigned char v_aidx;
-        unsigned char v_asize;
         Atom v_datum;
-        Atom *v_array;
-        hash_t v_hash;
-        struct Variable *v_next;
+        void *v_array;
+        size_t v_asize;
+        unsigned char v_flag;
+        unsigned char v_ndim;
 } Variable;
 #define v_value v_datum.a_value
 #define v_type  v_datum.a_type
@@ -308,9 +341,47 @@ typedef struct Variable {
 #define QC_VFLAG_INITIALIZED 0X01
 #define QC_VFLAG_CONST       0X02
 #define QC_VFLAG_ARRAY       0X04
+#define QC_VFLAG_ADDRTAKEN   0X08
+#define QC_VFLAG_STATIC      0X10 /* Stands for a `static' local */
+
+/**
+ * struct qc_symslot_t - Slot in a struct qc_symtab_t
+ * @s_hash: Hash number of @s_name
+ * @s_name: Symbol name, or NULL if the slot is unused. This points into
+ *      the symbol itself, or into storage that lives as long.
+ * @s_sym: The Function or Variable
+ */
+struct qc_symslot_t {
+        hash_t s_hash;
+        const char *s_name;
+        void *s_sym;
+};
+
+/**
+ * struct qc_symtab_t - Hash table of functions or variables with file or
+ *      global scope.
+ * @st_slot: @st_mask + 1 slots, or NULL until the first insert
+ * @st_mask: Number of slots minus one. The number of slots is a power of
+ *      two.
+ * @st_count: Number of slots used
+ *
+ * This uses open addressing: a symbol whose slot is taken goes in the
+ * next free one (linear probing), so a lookup is a scan of consecutive
+ * slots. The table doubles in size once it is QC_SYMTAB_LOAD percent
+ * full. Only the slots move; the symbols they point at do not. See
+ * qc_symtab_lookup() and qc_symtab_insert().
+ */
+struct qc_symtab_t {
+        struct qc_symslot_t *st_slot;
+        size_t st_mask;
+        size_t st_count;
+};
 
 #define QC_ISINIT(v)  (((v)->v_flag & QC_VFLAG_INITIALIZED) != 0)
 #define QC_ISARRAY(v) (((v)->v_flag & QC_VFLAG_ARRAY) != 0)
+#define QC_ISRDONLY(v) (((v)->v_flag & QC_VFLAG_CONST) != 0)
+/* Sizes of the dimensions of an array whose @v_ndim is not zero */
+#define QC_ARRAY_DIMS(v) ((const size_t *)(v)->v_array - (v)->v_ndim)
 
 struct Namespace;
 
@@ -318,11 +389,15 @@ struct Namespace;
  * union function_ptr_t - QC function pointer
  * @u:  For user-defined function, pointer to the start of the function's
  *      execution block in the program counter.
- * @i:  Pointer to an internal function
+ * @i:  Pointer to an internal function. It gets its arguments in order,
+ *      in place on the internal argument stack, and their number, which
+ *      is checked against the function's @f_minargs and @f_maxargs
+ *      already. It stores its result in `ret', whose type is set to
+ *      the function's @f_ret.
  */
 union function_cb_t {
         char *u;
-        void (*i)(Atom *);
+        void (*i)(Atom *args, int nargs, Atom *ret);
 };
 
 /**
@@ -336,15 +411,40 @@ union function_cb_t {
  *      functions) or qc_ifunc_call() (for internal functions).
  * @f_reg: Data type of the return value.  During the expression parsing,
  *      expression types will be changed to this.
- * @f_minargs:
- * @f_maxargs:  Until we support varargs, keep @f_minargs and @f_maxargs
- *      equal.
+ * @f_minargs: Number of arguments the function takes at least
+ * @f_maxargs: Number of arguments the function takes at most, or
+ *      QC_VARARGS if it takes any number after @f_minargs (internal
+ *      functions only). They are equal for user functions.
  * @f_namespace: Handle to the function's private functions, variables,
  *      etc.
- * @f_next: Next function in the hash table collision list.
- * @f_hash: Hash number
+ * @f_ncalls: Number of times the function has been called
+ * @f_inline: For a user function whose body is only `return <expr>;',
+ *      pointer to <expr> in the program buffer. Once the function is
+ *      hot, calls evaluate this directly (see qc_ufunc_inline()).
+ *      NULL for all other functions.
+ * @f_params: Parameters of a user function, in order, as they were read
+ *      when it was declared, or of a native one, as it was registered
+ *      (see qc_register_native()). There are @f_maxargs of them. Each
+ *      call casts its arguments to their types. NULL for the built-in
+ *      internal functions, which check their own arguments.
+ * @f_memo: For a user function declared `pure', its table of
+ *      remembered calls (see qc_ufunc_exec()). NULL for all other
+ *      functions.
  */
 
+#define QC_VARARGS 0xFF
+
+/*
+ * struct qc_param_t - Parameter of a user function
+ * @p_name: Its name (empty for a native function's)
+ * @p_type: Its declared type, with QC_CONST set if it is read-only
+ */
+struct qc_memo_t;
+struct qc_param_t {
+        char p_name[ID_LEN + 1];
+        qctoken_t p_type;
+};
+
 typedef struct Function {
         char f_name[ID_LEN + 1];
         union function_cb_t f_fn;
@@ -353,23 +453,130 @@ typedef struct Function {
         unsigned char f_minargs;
         unsigned char f_maxargs;
         struct Namespace *f_namespace;
-        struct Function *f_next;
-        hash_t f_hash;
+        unsigned long f_ncalls;
+        char *f_inline;
+        struct qc_param_t *f_params;
+        struct qc_memo_t *f_memo;
 } Function;
 
+/**
+ * struct qc_arena_t - Bump-pointer allocator
+ * @a_chunk: List of chunks allocated so far
+ * @a_next: Next free byte in the current chunk
+ * @a_end: End of the current chunk
+ *
+ * Everything a Namespace needs for as long as it is loaded is allocated
+ * from its arena, and freed all at once with it. See qc_arena_alloc().
+ * A zeroed struct is an empty arena.
+ */
+struct qc_arena_chunk_t;
+struct qc_arena_t {
+        struct qc_arena_chunk_t *a_chunk;
+        char *a_next;
+        char *a_end;
+};
+
 struct qc_ustring_t {
         char *s;
         char *p;
         char *e;
 };
 
+/**
+ * struct qc_heap_stats_t - Statistics of a Namespace's heap, see
+ *      qc_get_heap_stats()
+ * @hs_nalloc: Number of blocks allocated by malloc(), calloc() and
+ *      realloc()
+ * @hs_nfree: Number of blocks freed by free() and realloc()
+ * @hs_inuse: Number of bytes in blocks allocated now, as asked for
+ * @hs_peak: Highest that @hs_inuse has been
+ * @hs_pooled: Number of bytes taken from the arena for small blocks
+ * @hs_nbig: Number of blocks allocated now that were too big for a size
+ *      class
+ */
+struct qc_heap_stats_t {
+        unsigned long hs_nalloc;
+        unsigned long hs_nfree;
+        size_t hs_inuse;
+        size_t hs_peak;
+        size_t hs_pooled;
+        unsigned long hs_nbig;
+};
+
+/**
+ * struct qc_heap_t - Heap for a Namespace's malloc() and friends
+ * @h_free: Free list of each size class. Size class `i' holds blocks of
+ *      up to QC_HEAP_MINBLK << i bytes, which are carved out of the
+ *      Namespace's arena.
+ * @h_big: List of blocks too big for any size class. These are
+ *      malloc'd, and freed by qclib_namespace_exit() if the program
+ *      does not free them itself.
+ * @h_live: Every block that is allocated, in an open-addressing table of
+ *      2^@h_live_bits slots keyed by the address given to the program,
+ *      so that free() and realloc() can tell if a pointer is one of
+ *      them without reading what is in front of it. NULL if no block
+ *      has been allocated yet.
+ * @h_nlive: Number of blocks in @h_live
+ * @h_stats: Statistics
+ *
+ * A zeroed struct is an empty heap. See qclib.c.
+ */
+struct qc_mblk_t;
+struct qc_mbig_t;
+struct qc_heap_t {
+        struct qc_mblk_t *h_free[QC_HEAP_NCLASS];
+        struct qc_mbig_t *h_big;
+        struct qc_mblk_t **h_live;
+        size_t h_nlive;
+        int h_live_bits;
+        struct qc_heap_stats_t h_stats;
+};
+
+/*
+ * A loaded file. The Namespace itself, and everything else that lasts
+ * until it is unloaded (its program buffer, string literals, functions,
+ * variables and global arrays), are allocated from @arena.
+ *
+ * @program_buffer holds the program as load_program() filtered it. It
+ * is sized to the source file, which it is never longer than.
+ *
+ * @ustrings are its @n_ustrings string literals, in the order they
+ * appear, with room for @max_ustrings. @ustring_idx finds one by its
+ * location in @program_buffer; see qc_find_ustring().
+ *
+ * @var_seg is the storage for the file's variables, and @var_nseg the
+ * number of them used so far.
+ *
+ * @struct_tab holds the file's struct types by tag. Struct tags always
+ * have file scope.
+ *
+ * @heap holds the memory that the file's functions got from malloc().
+ *
+ * @folds are the @nfolds places in @program_buffer where the value of a
+ * `const' variable is read, with the value already in hand; see
+ * qc_fold_consts(). It is an open-addressing table of 2^@fold_bits
+ * slots in @arena, or NULL if there are none.
+ */
+struct qc_gvar_seg_t;
+struct qc_fold_t;
 typedef struct Namespace {
+        struct qc_arena_t arena;
         const char *filepath;
-        struct qc_ustring_t ustrings[QC_N_STRINGS];
+        struct qc_ustring_t *ustrings;
         int n_ustrings;
-        Function fn_hashtbl[NUM_STATIC_FUNC];
-        Variable var_hashtbl[NUM_STATIC_VARS];
-        char program_buffer[PROG_SIZE];
+        int max_ustrings;
+        int *ustring_idx;
+        int ustring_bits;
+        struct qc_symtab_t fn_tab;
+        struct qc_symtab_t var_tab;
+        struct qc_symtab_t struct_tab;
+        struct qc_gvar_seg_t *var_seg;
+        int var_nseg;
+        char *program_buffer;
+        struct qc_heap_t heap;
+        struct qc_fold_t *folds;
+        int fold_bits;
+        size_t nfolds;
         struct Namespace *list;
 } Namespace;
 
@@ -391,9 +598,16 @@ struct printf_reent_t {
 };
 
 /*
- * va_list/va_arg support. This will expand later.
+ * va_list/va_arg support, for internal functions that take a variable
+ * number of arguments, such as printf(). A qc_va_list walks the
+ * arguments after the fixed ones, as qc_va_start() sets it up. Reading
+ * past the last one is an error.
  */
-typedef void * qc_va_list;
+struct qc_va_t {
+        Atom *va_next;
+        Atom *va_end;
+};
+typedef struct qc_va_t *qc_va_list;
 #define qc_va_arg(ap, type)            \
       (sizeof(type) == sizeof(int)     \
         ? qc_va_iarg_int(ap)           \
@@ -405,35 +619,86 @@ typedef void * qc_va_list;
 extern int qc_va_iarg_int(qc_va_list args);
 extern long qc_va_iarg_long(qc_va_list args);
 extern long long qc_va_iarg_longlong(qc_va_list args);
-extern void qc_va_start(qc_va_list args, Variable *vstart);
-
-/* qcfunction.c */
-extern Atom *iarg_pop(void);
+extern void qc_va_start(qc_va_list args, Atom *first, int n);
 
 /* qcread.c */
 extern void qc_exit(int ret);
 extern int qc_main(char *fname);
 
 /* qclib.c (Our library functions) */
-extern void qccall_fopen(Atom *ret);
-extern void qccall_fclose(Atom *ret);
-extern void qccall_fputs(Atom *ret);
-extern void qccall_puts(Atom *ret);
-extern void qccall_printf(Atom *ret);
-extern void qccall_getchar(Atom *ret);
-extern void qccall_exit(Atom *ret);
+extern void qccall_fopen(Atom *args, int nargs, Atom *ret);
+extern void qccall_fclose(Atom *args, int nargs, Atom *ret);
+extern void qccall_fputs(Atom *args, int nargs, Atom *ret);
+extern void qccall_puts(Atom *args, int nargs, Atom *ret);
+extern void qccall_printf(Atom *args, int nargs, Atom *ret);
+extern void qccall_getchar(Atom *args, int nargs, Atom *ret);
+extern void qccall_exit(Atom *args, int nargs, Atom *ret);
+extern void qccall_malloc(Atom *args, int nargs, Atom *ret);
+extern void qccall_calloc(Atom *args, int nargs, Atom *ret);
+extern void qccall_realloc(Atom *args, int nargs, Atom *ret);
+extern void qccall_free(Atom *args, int nargs, Atom *ret);
+extern void qccall_memcpy(Atom *args, int nargs, Atom *ret);
+extern void qccall_memmove(Atom *args, int nargs, Atom *ret);
+extern void qccall_memset(Atom *args, int nargs, Atom *ret);
+extern void qccall_memcmp(Atom *args, int nargs, Atom *ret);
+extern void qccall_qsort(Atom *args, int nargs, Atom *ret);
+extern void qccall_foreach(Atom *args, int nargs, Atom *ret);
+extern void qccall_map(Atom *args, int nargs, Atom *ret);
 
 extern void qclib_exit(void);
 extern void qclib_init(void);
+extern void qclib_namespace_exit(Namespace *ns);
 
 
 /* qcerr.c */
 extern void qcsyntax(int error);
 
+/**
+ * struct qc_stats_t - Run-time statistics, see qc_get_stats()
+ * @s_int_fast: Number of binary operations on two `int's done by the
+ *      expression evaluator's own fast path
+ * @s_int_slow: Number of binary operations that fell back to the
+ *      generic qc_add(), qc_cmp(), etc.
+ * @s_const_fold: Number of reads of `const' variables whose value was
+ *      folded in at load time
+ * @s_memo_hit: Number of calls to `pure' functions that returned a
+ *      remembered result
+ * @s_memo_miss: Number of calls to `pure' functions that ran
+ */
+struct qc_stats_t {
+        unsigned long s_int_fast;
+        unsigned long s_int_slow;
+        unsigned long s_const_fold;
+        unsigned long s_memo_hit;
+        unsigned long s_memo_miss;
+};
+
+/**
+ * struct qc_config_t - Run-time limits, see qc_init()
+ * @c_max_lvars: Max number of local variables in all call frames
+ *      together, or zero for NUM_LOCAL_VARS
+ * @c_max_depth: Max depth of nested function calls, or zero for
+ *      NUM_FUNC
+ */
+struct qc_config_t {
+        size_t c_max_lvars;
+        size_t c_max_depth;
+};
+
 /* qcread.c (?) */
 int qc_execute(const char *funcname, Atom *ret, Atom args[], int nargs);
 int qc_load_file(const char *fname);
-int qc_init(void);
+int qc_init(const struct qc_config_t *cfg);
+void qc_get_stats(struct qc_stats_t *st);
+int qc_get_heap_stats(const char *fname, struct qc_heap_stats_t *st);
+void qc_print_stats(FILE *fp);
+
+/* qcfunction.c */
+int qc_register_native(const char *name,
+                       void (*fn)(Atom *args, int nargs, Atom *ret),
+                       qctoken_t ret_type, const qctoken_t arg_types[],
+                       int nargs);
+void qc_call_function(Function *fn, Atom *args, int nargs, Atom *ret);
 
 /* qcprint.c */
 extern void qcprint_r(const char *restrict format, qc_va_list args,
@@ -23,23 +23,49 @@
 /* TODO: Rename these something cleaner */
 
 /*
- * Size of global-function hash table. Prime number is hash-optimal.
- * The actual number of permissible global functions depends on memory
- * available.
+ * Default max depth of nested function calls. The stack of call frames
+ * grows as needed up to this. Each call also takes a couple of KB of the
+ * C stack. Programs may set their own with qc_init().
  */
-#define NUM_FUNC         71
+#define NUM_FUNC         1000
 
-/* What I just said about NUM_FUNC, say again for NUM_GLOBAL_VARS */
-#define NUM_GLOBAL_VARS  71
+/*
+ * Initial number of slots in each function and variable hash table.
+ * Tables grow as needed, so the number of functions and variables
+ * depends only on memory available. Must be a power of two.
+ */
+#define QC_SYMTAB_INIT   64
+
+/* Percent full a hash table may get before it is resized */
+#define QC_SYMTAB_LOAD   70
+
+/* Variables with file or global scope are allocated this many at a time */
+#define QC_SYM_SEGSIZE   64
 
 /*
- * Size of the local variable stack. This affect the number of function
- * calls.
+ * Size of each chunk of memory that a loaded file's arena allocates
+ * from. Anything bigger than a quarter of this gets a chunk of its own.
  */
-#define NUM_LOCAL_VARS   1024
+#define QC_ARENA_CHUNK   (64 * 1024)
 
-/* Max number of internal function parameters */
-#define NUM_INTL_ARGS    10
+/*
+ * Default max size of the local variable stack, shared by all call
+ * frames. Programs may set their own with qc_init().
+ */
+#define NUM_LOCAL_VARS   65536
+
+/*
+ * The local variable stack grows by this many variables at a time.
+ * Power of two is fastest.
+ */
+#define QC_LVAR_SEGSIZE  256
+
+/*
+ * Size of the stack of internal function arguments. A call's arguments
+ * are stacked above those of any call it is an argument of, so this is
+ * also the most that a variadic function such as printf() may take.
+ */
+#define NUM_INTL_ARGS    128
 
 /*
  * Max number of characters per identifier, not counting terminating
@@ -51,36 +77,112 @@
 
 #define NUM_PARAMS       31
 
-/* Number of bytes per loadable program */
-#define PROG_SIZE        10000
+/*
+ * Number of calls after which a user function whose body is a single
+ * `return' statement is evaluated inline, without a call frame of its
+ * own.
+ */
+#define QC_INLINE_HOT    8
+
+/*
+ * Number of calls that each function declared `pure' remembers the
+ * result of.
+ */
+#define QC_MEMO_SIZE     64
 
 /* Max number of nested `for' loops */
 #define FOR_NEST         31
 
+/*
+ * Number of `for' loop headers whose analysis is remembered between
+ * runs of the loop. Prime number is hash-optimal.
+ */
+#define QC_LOOP_CACHE    61
+
+/*
+ * Max number of array index sites per `for' loop whose element address
+ * is walked along with the induction variable.
+ */
+#define QC_LOOP_WALKERS  8
+
+/*
+ * Max trip count of a `for' loop to run unrolled. Such a loop must have
+ * literal bounds and an induction variable that its body leaves alone.
+ */
+#define QC_UNROLL_MAX    64
+
+/*
+ * Set to 1 (eg with -DQC_BOUNDS_CHECK_ALWAYS=1) to check array bounds
+ * on every access, even when the index is a `for' loop's induction
+ * variable that has been proven to stay in range.
+ */
+#ifndef QC_BOUNDS_CHECK_ALWAYS
+# define QC_BOUNDS_CHECK_ALWAYS 0
+#endif
+
 /* Max length of a token */
 #define TOKEN_LEN        80
 
-/* Max number of string literals */
-#define QC_N_STRINGS     100
+/*
+ * Initial number of string literals per file. There may be any number
+ * of them; the table doubles as needed.
+ */
+#define QC_N_STRINGS     128
 
-/* Max length of string literals */
+/*
+ * Initial size of the buffer that string literals are converted in.
+ * They may be any length; the buffer grows as needed.
+ */
 #define QC_STRING_LEN    512
 
 /* Max number of open files. This may be further limited by the
  * system. */
 #define QC_NFILES        20
 
-/* Max number of file-scope variables. Prime number is hash-optimal */
-#define NUM_STATIC_VARS  71
+/* Max size of an array declared inside a function */
+#define QC_LARRAY_MAX    (1UL << 28)
 
-/* Max number of file-scope functions, Prime number is hash-optimal */
-#define NUM_STATIC_FUNC  71
+/*
+ * Local arrays bigger than this many bytes are allocated from the heap
+ * instead of the local array data stack (see QC_LDATA_SIZE).
+ */
+#define QC_LARRAY_HEAP   4096
 
-/* Max size of an array declared inside a function */
-#define QC_LARRAY_MAX    NUM_LOCAL_VARS
+/*
+ * Number of bytes of storage for local arrays, shared by all call
+ * frames. Local arrays that do not fit go on the heap.
+ */
+#define QC_LDATA_SIZE    (64 * 1024)
+
+/*
+ * Size classes of the malloc() builtin: the smallest holds blocks of up
+ * to QC_HEAP_MINBLK bytes, and each one after holds blocks twice as big.
+ * Bigger blocks are malloc'd from the system one at a time.
+ */
+#define QC_HEAP_MINBLK   16
+#define QC_HEAP_NCLASS   8
+
+/* A size class with no free blocks gets about this many bytes more */
+#define QC_HEAP_SLAB     4096
 
 /* Max size of an array declared outside a function */
-#define QC_GARRAY_MAX    1000
+#define QC_GARRAY_MAX    (1UL << 28)
+
+/* Max number of dimensions of an array, eg 2 for `int m[3][4]' */
+#define QC_ARRAY_MAXDIM  8
+
+/*
+ * Number of entries in the cache of resolved struct member accesses,
+ * `s.x' and `p->x'.
+ */
+#define QC_MEMBER_CACHE  127
+
+/*
+ * Max number of `const' variables that one function may hide with
+ * parameters or locals of the same name, and still have the reads of
+ * the others folded. See qcfold.c.
+ */
+#define QC_FOLD_MAXHIDE  8
 
 
 
@@ -25,11 +25,19 @@ extern char qc_tokmap[];
 #define QCTOK_ISMULDIVMOD(tk) ((qc_tokmap[(tk) & 0x7FU] & QC_TKM_) != 0)
 #define QCTOK_ISUNARY(tk)     ((qc_tokmap[(tk) & 0x7FU] & QC_TKU_) != 0)
 
+/*
+ * True if both `a' and `b' are `int' atoms. The pair of types is checked
+ * with a single compare.
+ */
+#define QC_BOTH_INT(a, b)                                      \
+        ((((unsigned int)QC_TYPEOF((a)->a_type) << 16)         \
+          | QC_TYPEOF((b)->a_type)) == ((QC_INT << 16) | QC_INT))
+
 /*
  * Saved state of the program, for when qcputback() is insufficient.
  */
 struct qc_program_t {
-        char pb_tksbuf[ID_LEN];
+        char pb_tksbuf[TOKEN_LEN];
         qctoken_t pb_tok;
         char *pb_tks;
         char *pb_pc;
@@ -38,12 +46,71 @@ struct qc_program_t {
 
 #define qc_func_call(var, p)  (p)->f_call(var, p);
 
+/**
+ * struct qc_field_t - Member of a struct type
+ * @f_name: Member name
+ * @f_type: Member type, or the type of its elements if it is an array
+ * @f_offset: Offset in bytes from the start of the struct
+ * @f_asize: Number of elements if the member is an array, else zero
+ */
+struct qc_field_t {
+        char f_name[ID_LEN + 1];
+        qctoken_t f_type;
+        size_t f_offset;
+        size_t f_asize;
+};
+
+/**
+ * struct qc_struct_t - Struct type, see qcstruct.c
+ * @st_name: Tag
+ * @st_type: The type token for this struct
+ * @st_size: Size in bytes, including any padding at the end, so that
+ *      consecutive elements of an array stay aligned
+ * @st_align: Alignment, that of its most-aligned member
+ * @st_nfield: Number of members
+ * @st_field: The members, in order of declaration
+ * @st_ns: Namespace that declared it, and whose arena holds it
+ */
+struct qc_struct_t {
+        char st_name[ID_LEN + 1];
+        qctoken_t st_type;
+        size_t st_size;
+        size_t st_align;
+        int st_nfield;
+        struct qc_field_t *st_field;
+        Namespace *st_ns;
+};
+
+/**
+ * struct qc_fold_t - A place where a `const' variable is read, a local
+ * array's initializer list, or a function's `static' declaration, see
+ * qcfold.c
+ * @cf_site: Location of the variable's name or the list's `{' in the
+ *      program buffer, or NULL if the slot is not used
+ * @cf_value: The variable's value. For a list, a pointer to its
+ *      elements, whose type is that of the array's elements. For a
+ *      `static' declaration, a pointer to the Variable.
+ * @cf_end: For a list, the location just past its `}'; for a
+ *      declaration, the location just past the declarator
+ * @cf_count: For a list, the number of elements
+ */
+struct qc_fold_t {
+        const char *cf_site;
+        Atom cf_value;
+        char *cf_end;
+        size_t cf_count;
+};
+
+/* The struct that type `tk' is, or points to */
+#define qc_struct_of(tk) (qc_struct_tbl[QC_STRUCTID(tk)])
+
 extern Namespace *qc_namespace_list; /* For easy cleanup */
 extern qctoken_t qc_token;
 extern char *qc_token_string;
 extern char qc_token_string_buffer[];
 extern char *qc_program_counter;
 extern jmp_buf qc_jmp_buf;
+extern struct qc_stats_t qc_stats;
 
 /* qcfunction.c */
 extern Function *qc_func_lookup(const char *name);
@@ -54,11 +121,14 @@ extern void qc_decl_local(void);
 extern void qc_decl_local_array(void);
 extern void qc_decl_global(void);
 extern void qc_decl_global_array(void);
+extern qctoken_t qc_get_type(void);
 extern Variable *qc_uvar_lookup(const char *s);
+extern Variable *qc_local_uvar_lookup(const char *s);
+extern int qc_lvar_inframe(Variable *v);
 extern void assign_var(const char *s, Atom *v);
 #define qc_uvar_bound_check(p) 0 /* deprecated */
 extern void assign_var_deref(Variable *p, Atom *v);
-extern int qc_function_init(void);
+extern int qc_function_init(const struct qc_config_t *cfg);
 extern void qc_function_namespace_init(Namespace *namespace);
 extern void qc_function_namespace_exit(Namespace *ns);
 extern void qc_function_exit(void);
@@ -75,13 +145,20 @@ extern char *qc_program_counter;
 extern qctoken_t qc_token;
 extern char *qc_token_string;
 extern char qc_token_string_buffer[TOKEN_LEN];
-extern struct qc_ustring_t qc_ustrings[QC_N_STRINGS];
-extern int qc_n_ustrings;
 extern int qc_find_ustring(const char *s);
 extern int qc_interpret_block(void);
+extern int qc_loop_index_inbounds(Variable *iv, size_t size);
+extern void *qc_loop_walker(const char *site, Variable *array);
+extern void qc_loop_walker_add(char *site, char *end, Variable *array,
+                               Variable *iv, void *elem);
 
 /* qcinst.c */
 extern void qc_int_crop(Atom *v);
+extern size_t qc_type_size(qctoken_t type);
+extern size_t qc_type_align(qctoken_t type);
+extern long qc_ptr_stride(qctoken_t type);
+extern void qc_load(Atom *a, const void *addr, qctoken_t type);
+extern void qc_store(void *addr, qctoken_t type, Atom *v);
 extern void qc_mov(Atom *to, Atom *from);
 extern void qc_add(Atom *to, Atom *from);
 extern void qc_sub(Atom *to, Atom *from);
@@ -97,6 +174,22 @@ extern void qc_lnot(Atom *v);
 extern void qc_asl(Atom *v, Atom *amt);
 extern void qc_asr(Atom *v, Atom *amt);
 
+/* qcfold.c */
+extern void qc_fold_consts(void);
+extern void qc_fold_array(const char *site, char *end, qctoken_t type,
+                          void *data, size_t count);
+extern void qc_fold_static(const char *site, char *end, Variable *v);
+extern const struct qc_fold_t *qc_fold_lookup(const char *site);
+extern void qc_fold_namespace_exit(Namespace *ns);
+
+/* qcstruct.c */
+extern struct qc_struct_t **qc_struct_tbl;
+extern void qc_struct_declare(void);
+extern qctoken_t qc_struct_type(const char *tag);
+extern const struct qc_field_t *qc_struct_member(qctoken_t type);
+extern void qc_struct_namespace_exit(Namespace *ns);
+extern void qc_struct_exit(void);
+
 /* qcerr.c */
 extern const char *qc_strerror(int error);
 extern void qc_printerr(int error, char *pc);
@@ -104,6 +197,14 @@ extern void qc_printerr(int error, char *pc);
 /* qchelpers.c */
 extern hash_t qc_symbol_hash(const char *s);
 extern hash_t qc_symbol_hash2delim(const char *s);
+extern void *qc_symtab_lookup(const struct qc_symtab_t *st,
+                              const char *name, hash_t hash);
+extern int qc_symtab_insert(struct qc_symtab_t *st, const char *name,
+                            hash_t hash, void *sym);
+extern void qc_symtab_free(struct qc_symtab_t *st);
+extern void *qc_arena_alloc(struct qc_arena_t *a, size_t size);
+extern char *qc_arena_strdup(struct qc_arena_t *a, const char *s);
+extern void qc_arena_free(struct qc_arena_t *a);
 extern void qc_program_save(struct qc_program_t *penv);
 extern void qc_program_restore(struct qc_program_t *penv);
 
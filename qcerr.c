@@ -53,9 +53,12 @@ const char *qc_strerror(int error)
                 "double pointers not yet supported",
                 "array too big",
                 "closing square brace expected",
-                "array initialization-at-declaration not supported",
+                "bad array initializer",
                 "insane left/right shifting",
                 "array out of bounds",
+                "freeing memory that was not allocated",
+                "no such struct member",
+                "assignment to const variable",
         };
         const char *s;
 
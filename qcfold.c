@@ -0,0 +1,319 @@
+/*
+ * Folding of `const' variables.
+ *
+ * A `const' variable outside of a function gets its value from its
+ * initializer during prescan, and never gets another. So once a file is
+ * scanned, every place in it where such a variable is read is entered
+ * in a table, by its location in the program buffer, along with the
+ * value. When the parser gets to one of those places, it takes the
+ * value from the table instead of looking the name up; see qc_atom().
+ *
+ * Only variables that are neither arrays nor structs are folded, and
+ * not in a function that has a parameter or local variable of the same
+ * name, which might hide it.
+ *
+ * The same table holds the initializer lists of local arrays whose
+ * elements are all literals, by the location of their `{'. Such a list
+ * is evaluated the first time it is reached, and after that it is copied
+ * into the array whole; see qc_decl_local(). So do the declarations of
+ * a function's `static' variables, which are set up only the first time
+ * they are reached.
+ */
+#include "qc.h"
+#include "qc_private.h"
+#include <stdint.h>
+#include <string.h>
+
+/* Slot in a table of 2^`bits' entries to start looking for `site' */
+static inline size_t fold_home(const char *site, int bits)
+{
+        return (size_t)(((unsigned long long)(uintptr_t)site
+                         * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+/*
+ * Enter `site' in the current Namespace's table. The table is doubled
+ * once it is half full. The old one is left in the arena, which costs
+ * no more than the new one does.
+ *
+ * Return: The new entry, for the caller to fill in
+ */
+static struct qc_fold_t *fold_insert(const char *site)
+{
+        Namespace *ns = qc_namespace;
+        struct qc_fold_t *tbl, *cf;
+        size_t i, j, mask, n;
+        int bits;
+
+        n = ns->folds == NULL ? 0 : (size_t)1 << ns->fold_bits;
+        if (ns->nfolds + 1 > n / 2) {
+                bits = ns->folds == NULL ? 6 : ns->fold_bits + 1;
+                mask = ((size_t)1 << bits) - 1;
+                tbl = qc_arena_alloc(&ns->arena, (mask + 1) * sizeof(*tbl));
+                if (tbl == NULL)
+                        qcsyntax(QCE_NOMEM);
+                memset(tbl, 0, (mask + 1) * sizeof(*tbl));
+                for (i = 0; i < n; ++i) {
+                        cf = &ns->folds[i];
+                        if (cf->cf_site == NULL)
+                                continue;
+                        for (j = fold_home(cf->cf_site, bits);
+                             tbl[j].cf_site != NULL; j = (j + 1) & mask)
+                                ;
+                        tbl[j] = *cf;
+                }
+                ns->folds = tbl;
+                ns->fold_bits = bits;
+        }
+
+        mask = ((size_t)1 << ns->fold_bits) - 1;
+        for (i = fold_home(site, ns->fold_bits); ns->folds[i].cf_site != NULL;
+             i = (i + 1) & mask)
+                ;
+        ns->folds[i].cf_site = site;
+        ++ns->nfolds;
+        return &ns->folds[i];
+}
+
+/*
+ * Return: The variable named `name' if it is one whose reads may be
+ * folded, else NULL
+ */
+static Variable *fold_var(const char *name)
+{
+        Variable *v;
+
+        v = qc_uvar_lookup(name);
+        if (v == NULL || !QC_ISRDONLY(v) || QC_ISARRAY(v)
+            || QC_ISSTRUCT(v->v_type))
+                return NULL;
+        return v;
+}
+
+/*
+ * Helper to qc_fold_consts(). Fold the reads in the function whose
+ * parameter list starts at `start'. It is scanned twice: first for the
+ * names it declares, which may hide a `const' variable, and then for the
+ * reads; if it declares too many such names, it is left alone. On
+ * return, the program counter is past the function's body.
+ */
+static void fold_function(char *start)
+{
+        Variable *hide[QC_FOLD_MAXHIDE];
+        Variable *v, *pend;
+        const char *site;
+        qctoken_t prev;
+        int nhide = 0;
+        int toomany = 0;
+        int pass, brace, isdecl, decl, i;
+
+        for (pass = 0; pass < 2 && !toomany; ++pass) {
+                qc_program_counter = start;
+                prev = 0;
+                pend = NULL;
+                site = NULL;
+                brace = 0;
+                isdecl = 0;
+                do {
+                        qc_lex();
+
+                        /* Fold a read, unless it is assigned, or is
+                         * followed by something that treats it as more
+                         * than a value */
+                        if (pend != NULL) {
+                                switch (QC_TOK(qc_token)) {
+                                case QC_OPENSQU:
+                                case QC_OPENPAREN:
+                                case QC_DOT:
+                                case QC_ARROW:
+                                        break;
+                                default:
+                                        if (QC_ISASGN_OP(qc_token))
+                                                break;
+                                        fold_insert(site)->cf_value
+                                                = pend->v_datum;
+                                        break;
+                                }
+                                pend = NULL;
+                        }
+
+                        switch (QC_TOK(qc_token)) {
+                        case QC_OPENBR:
+                                ++brace;
+                                isdecl = 0;
+                                break;
+                        case QC_CLOSEBR:
+                                --brace;
+                                /* Fall through */
+                        case QC_SEMI:
+                        case QC_CLOSEPAREN:
+                                isdecl = 0;
+                                break;
+                        case QC_STRUCT:
+                                /* The tag is part of the type */
+                                qc_lex();
+                                prev = QC_STRUCT | QC_TYPE;
+                                isdecl = 1;
+                                continue;
+                        case QC_FINISHED:
+                                qcsyntax(QCE_UNBAL_BRACES);
+                                break;
+                        case QC_IDENTIFIER:
+                                decl = QC_ISTYPE(prev)
+                                       || (isdecl
+                                           && (QC_TOK(prev) == QC_MULTOK
+                                               || QC_TOK(prev) == QC_COMMA));
+                                if (QC_TOK(prev) == QC_DOT
+                                    || QC_TOK(prev) == QC_ARROW)
+                                        break;
+                                v = fold_var(qc_token_string);
+                                if (v == NULL)
+                                        break;
+                                if (pass == 0) {
+                                        if (!decl)
+                                                break;
+                                        /* Too many to keep track of */
+                                        if (nhide == QC_FOLD_MAXHIDE)
+                                                toomany = 1;
+                                        else
+                                                hide[nhide++] = v;
+                                        break;
+                                }
+                                for (i = 0; i < nhide; ++i) {
+                                        if (hide[i] == v)
+                                                break;
+                                }
+                                if (i == nhide && !decl) {
+                                        pend = v;
+                                        site = qc_program_counter_save;
+                                }
+                                break;
+                        default:
+                                if (QC_ISTYPE(qc_token))
+                                        isdecl = 1;
+                                break;
+                        }
+                        prev = qc_token;
+                } while (brace > 0 || QC_TOK(qc_token) != QC_CLOSEBR);
+        }
+}
+
+/**
+ * qc_fold_consts - Fold the reads of `const' variables in the current
+ * Namespace's program. Part of prescan, after everything else in it.
+ *
+ * The program counter is left at the end of the program.
+ */
+void qc_fold_consts(void)
+{
+        char *start = NULL;
+        int brace = 0;
+
+        qc_program_counter = qc_namespace->program_buffer;
+        for (;;) {
+                qc_lex();
+                switch (QC_TOK(qc_token)) {
+                case QC_FINISHED:
+                        return;
+                case QC_OPENPAREN:
+                        if (brace == 0 && start == NULL)
+                                start = qc_program_counter_save;
+                        break;
+                case QC_OPENBR:
+                        if (brace == 0 && start != NULL) {
+                                fold_function(start);
+                                start = NULL;
+                        } else {
+                                /* A struct's body */
+                                ++brace;
+                        }
+                        break;
+                case QC_CLOSEBR:
+                        --brace;
+                        break;
+                case QC_SEMI:
+                        if (brace == 0)
+                                start = NULL;
+                        break;
+                }
+        }
+}
+
+/**
+ * qc_fold_array - Keep the value of an array's initializer list.
+ * @site: Location of the list's `{' in the current Namespace's program
+ *      buffer, as qc_lex() left it in qc_program_counter_save
+ * @end: Location just past the list's `}'
+ * @type: Type of the array's elements
+ * @data: The elements, packed like the array; this must last as long
+ *      as the Namespace
+ * @count: Number of elements
+ */
+void qc_fold_array(const char *site, char *end, qctoken_t type,
+                   void *data, size_t count)
+{
+        struct qc_fold_t *cf;
+
+        cf = fold_insert(site);
+        cf->cf_value.a_type = type | QC_PTR;
+        cf->cf_value.a_value.p = data;
+        cf->cf_end = end;
+        cf->cf_count = count;
+}
+
+/**
+ * qc_fold_static - Keep a function's `static' variable.
+ * @site: Location of the variable's name in its declaration in the
+ *      current Namespace's program buffer
+ * @end: Location just past the declarator
+ * @v: The variable; this must last as long as the Namespace
+ */
+void qc_fold_static(const char *site, char *end, Variable *v)
+{
+        struct qc_fold_t *cf;
+
+        cf = fold_insert(site);
+        cf->cf_value.a_type = 0;
+        cf->cf_value.a_value.p = v;
+        cf->cf_end = end;
+        cf->cf_count = 0;
+}
+
+/**
+ * qc_fold_lookup - Find out if a `const' variable's value was folded in
+ * at a place in the program, or if an initializer list there was kept.
+ * @site: Location of the variable's name, or of the `{', in the current
+ *      Namespace's program buffer, as qc_lex() left it in
+ *      qc_program_counter_save
+ *
+ * Return: The entry for @site, or NULL if it has none
+ */
+const struct qc_fold_t *qc_fold_lookup(const char *site)
+{
+        Namespace *ns = qc_namespace;
+        struct qc_fold_t *cf;
+        size_t i, mask;
+
+        if (ns->folds == NULL)
+                return NULL;
+        mask = ((size_t)1 << ns->fold_bits) - 1;
+        for (i = fold_home(site, ns->fold_bits); ; i = (i + 1) & mask) {
+                cf = &ns->folds[i];
+                if (cf->cf_site == site)
+                        return cf;
+                if (cf->cf_site == NULL)
+                        return NULL;
+        }
+}
+
+/**
+ * qc_fold_namespace_exit - Forget @ns's table of folded reads and kept
+ * initializer lists. (The table and the lists are in its arena.)
+ * @ns: Pointer to the Namespace to clean up.
+ */
+void qc_fold_namespace_exit(Namespace *ns)
+{
+        ns->folds = NULL;
+        ns->fold_bits = 0;
+        ns->nfolds = 0;
+}
@@ -4,6 +4,7 @@
 #include "qc_private.h"
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 /* For minibuf stuff */
 #include <ctype.h>
@@ -11,44 +12,111 @@
 
 static Atom qc_return_val;
 
-/* Hash table for public functions */
-static Function qc_function_hashtbl[NUM_FUNC];
-static Variable qc_gvar_hashtbl[NUM_GLOBAL_VARS];
+/*
+ * Hash tables for public functions and variables. Except for the
+ * internal functions, what they point at belongs to the Namespace that
+ * declared it, and is allocated from its arena.
+ */
+static struct qc_symtab_t qc_function_tab;
+static struct qc_symtab_t qc_gvar_tab;
+
+/*
+ * Storage for a Namespace's variables, allocated from its arena
+ * QC_SYM_SEGSIZE at a time. As on the local variable stack, the names
+ * are kept apart from the variables.
+ */
+struct qc_gvar_seg_t {
+        Variable gs_var[QC_SYM_SEGSIZE];
+        char gs_name[QC_SYM_SEGSIZE][ID_LEN + 1];
+};
 
 /*
- * Stack for user-defined local (ie inside a function) variables.
+ * Stack for user-defined local (ie inside a function) variables. It is
+ * made of segments of QC_LVAR_SEGSIZE variables, allocated as the stack
+ * grows and kept for reuse until qc_function_exit(). Segments never
+ * move, so pointers to local variables stay valid. A segment keeps its
+ * variables' names apart from the variables, since only lookups by name
+ * need them.
  */
-static Variable qc_lvar_stack[NUM_LOCAL_VARS];
+struct qc_lvar_seg_t {
+        Variable ls_var[QC_LVAR_SEGSIZE];
+        char ls_name[QC_LVAR_SEGSIZE][ID_LEN + 1];
+};
+static struct qc_lvar_seg_t **qc_lvar_seg = NULL;
+static int qc_lvar_nseg = 0;
 static int qc_lvar_tos = 0;
+static int qc_lvar_max = NUM_LOCAL_VARS;
+
+/*
+ * Stack for the elements of user-defined local arrays, in units of
+ * long long so every element is aligned.
+ */
+static long long qc_ldata_stack[QC_LDATA_SIZE / sizeof(long long)];
+static size_t qc_ldata_tos = 0;
+
+/*
+ * Local arrays too big for the data stack (see QC_LARRAY_HEAP). Each is
+ * allocated with this header in front of it, and pushed onto a list
+ * that is unwound, like the stacks above, when the function returns.
+ */
+struct qc_lheap_t {
+        struct qc_lheap_t *lh_next;
+        long long lh_data[];
+};
+static struct qc_lheap_t *qc_lheap = NULL;
 
 /*
  * Stack of function calls (kind of like a stack of link reg.
- * values)
+ * values). Each entry holds the caller's local variable stack index
+ * and local array data stack index. It is doubled when it is full, up
+ * to qc_func_max frames, and kept until qc_function_exit(); entries are
+ * only used by index, so they may move.
  */
-static int qc_func_stack[NUM_FUNC];
+struct qc_frame_t {
+        int fr_lvar;
+        size_t fr_ldata;
+        struct qc_lheap_t *fr_lheap;
+};
+static struct qc_frame_t *qc_func_stack = NULL;
+static int qc_func_nframe = 0;
 static int qc_func_tos = 0;
+static int qc_func_max = NUM_FUNC;
 
 /*
- * Stack of arguments into internal one function call
+ * Stack of arguments into internal function calls. Each call's are
+ * above those of the call whose arguments it is part of, if any.
  */
 static Atom qc_iarg_stack[NUM_INTL_ARGS];
 static int qc_iarg_tos = 0;
 
+/*
+ * Functions added by qc_register_native(). Each one is a single block
+ * with its parameters, kept on this list until qc_function_exit().
+ */
+struct qc_native_t {
+        struct qc_native_t *n_next;
+        Function n_fn;
+        struct qc_param_t n_params[];
+};
+static struct qc_native_t *qc_natives = NULL;
+
 
-static int qc_get_iargs_from_ufunc(void);
 static void qc_ifunc_call(Atom *ret, struct Function *fn);
 static void qc_ufunc_call(Atom *ret, struct Function *fn);
-static void qc_push_uargs(void);
-static void qc_get_uparams(void);
+static void qc_ufunc_inline(Atom *ret, Function *fn, int lvartemp);
+static void qc_push_uarg(const struct qc_param_t *p, Atom *a);
+static void qc_push_uargs(Function *fn);
+static void qc_name_uparams(Function *fn, int i);
 static int qc_ufunc_pop(void);
 static void qc_ufunc_push(int i);
-static void local_push(Variable *v);
-static Variable *qc_local_uvar_lookup(const char *s);
+static Variable *local_push(const char *name, Variable *v);
+static Variable *local_slot(const char *name);
+static void local_grow(void);
+static void *local_alloc(size_t size);
+static void local_heap_unwind(struct qc_lheap_t *to);
 static Variable *qc_global_uvar_lookup(const char *s);
-static qctoken_t qc_get_type(void);
-static void qc_fn_collision_insert(Function *new, Function *root);
-static void qc_gvar_collision_insert(Variable *new, Variable *root);
-static void qc_push_uargs_from_minibuf(void);
+static void qc_push_uargs_from_minibuf(Function *fn);
+static qctoken_t decl_type(qctoken_t type);
 
 /*
  * Table of internal functions. They will be copied and hased
@@ -60,8 +128,6 @@ static void qc_push_uargs_from_minibuf(void);
           .f_minargs = (min),            \
           .f_maxargs = (max),            \
           .f_ret     = (typ),            \
-          .f_next    = NULL,               \
-          .f_hash    = -1,                 \
           .f_call    = qc_ifunc_call, }
 #define IFUNC_END \
         { .f_name = { '\0' }, .f_fn.i = NULL, .f_ret = 0 }
@@ -71,36 +137,40 @@ static Function qc_ifunc_tbl[] = {
         IFUNC_PARAMS(fputs,  2, 2, QC_TYPE | QC_INT),
         IFUNC_PARAMS(exit,   1, 1, QC_TYPE | QC_INT),
         IFUNC_PARAMS(puts,   1, 1, QC_TYPE | QC_CHAR | QC_PTR),
-        IFUNC_PARAMS(printf, 1, 9, QC_TYPE | QC_INT),
+        IFUNC_PARAMS(printf, 1, QC_VARARGS, QC_TYPE | QC_INT),
         IFUNC_PARAMS(getchar,0, 0, QC_TYPE | QC_INT),
+        IFUNC_PARAMS(malloc, 1, 1, QC_TYPE | QC_VOIDPTR),
+        IFUNC_PARAMS(calloc, 2, 2, QC_TYPE | QC_VOIDPTR),
+        IFUNC_PARAMS(realloc,2, 2, QC_TYPE | QC_VOIDPTR),
+        IFUNC_PARAMS(free,   1, 1, QC_TYPE | QC_VOID),
+        IFUNC_PARAMS(memcpy, 3, 3, QC_TYPE | QC_VOIDPTR),
+        IFUNC_PARAMS(memmove,3, 3, QC_TYPE | QC_VOIDPTR),
+        IFUNC_PARAMS(memset, 3, 3, QC_TYPE | QC_VOIDPTR),
+        IFUNC_PARAMS(memcmp, 3, 3, QC_TYPE | QC_INT),
+        IFUNC_PARAMS(qsort,  3, 3, QC_TYPE | QC_VOID),
+        IFUNC_PARAMS(foreach,3, 3, QC_TYPE | QC_INT),
+        IFUNC_PARAMS(map,    3, 3, QC_TYPE | QC_INT),
         IFUNC_END,
 };
 
-/* Bottom of local var stack for current function only */
-static inline Variable *qc_lvar_stack_bottom(void)
-{
-        int i = qc_func_stack[qc_func_tos - 1];
-        return &qc_lvar_stack[i];
-}
-
-static inline Variable *qc_lvar_stack_top(void)
+/* Local variable at index `i' of the stack */
+static inline Variable *qc_lvar_at(int i)
 {
-        return &qc_lvar_stack[qc_lvar_tos - 1];
+        return &qc_lvar_seg[(unsigned int)i / QC_LVAR_SEGSIZE]
+                ->ls_var[(unsigned int)i % QC_LVAR_SEGSIZE];
 }
 
-/* Helpers to clear out entries in hash tables */
-static void qc_function_hashinit1(Function *t)
+/* Name of the local variable at index `i' of the stack */
+static inline char *qc_lvar_name(int i)
 {
-        t->f_hash = -1;
-        t->f_name[0] = '\0';
-        t->f_next = NULL;
+        return qc_lvar_seg[(unsigned int)i / QC_LVAR_SEGSIZE]
+                ->ls_name[(unsigned int)i % QC_LVAR_SEGSIZE];
 }
 
-static void qc_gvar_hashinit1(Variable *v)
+/* Index of the bottom of local var stack for current function only */
+static inline int qc_lvar_stack_bottom(void)
 {
-        v->v_hash = -1;
-        v->v_name[0] = '\0';
-        v->v_next = NULL;
+        return qc_func_tos > 0 ? qc_func_stack[qc_func_tos - 1].fr_lvar : 0;
 }
 
 /* TODO: Get rid of this when porting into vmebr, and put
@@ -150,173 +220,174 @@ int token_next_atom(Atom *a)
 }
 
 /*
- * Common to qc_get_iargs_from_minibuf() and
- * qc_get_iargs_from_ufunc(). `top' is the top of
- * a temporary array in those functions and count
- * is the array length.
- */
-static void qc_iarg_push(Atom *top, int count)
-{
-        while (count > 0) {
-                /* Push onto qc_iarg_stack */
-                top->a_type |= QC_ARG;
-                if (qc_iarg_tos >= NUM_INTL_ARGS)
-                        qcsyntax(QCE_TOO_MANY_LVARS);
-                memcpy(&qc_iarg_stack[qc_iarg_tos],
-                        top,
-                        sizeof(*top));
-                qc_iarg_tos++;
-                --count;
-                --top;
-        }
+ * Store `a' as the next argument of an internal function call, at the
+ * top of qc_iarg_stack.
+ */
+static void qc_iarg_push(Atom *a)
+{
+        if (qc_iarg_tos >= NUM_INTL_ARGS)
+                qcsyntax(QCE_TOO_MANY_LVARS);
+        qc_iarg_stack[qc_iarg_tos++] = *a;
 }
 
 /*
  * Get arguments from the command interpreter (either from a
  * file or minibuffer -- the token_next() interface will do for
  * both before calling an internal function.
- *
- * Return:
- *  Number of arguments.
  */
-static int qc_get_iargs_from_minibuf(void)
+static void qc_get_iargs_from_minibuf(void)
 {
-        Atom params[NUM_PARAMS];
-        Atom *v;
-        int count = 0;
-        int res;
-
-        v = &params[0];
-
-        while ((res = token_next_atom(v)) != 0) {
-                ++count;
-                ++v;
-                if (count == NUM_PARAMS)
-                        break;
-        }
+        Atom a;
 
-        /* now, push on qc_lvar_stack in reverse order */
-        --v;
-        qc_iarg_push(v, count);
-        return count;
+        while (token_next_atom(&a) != 0)
+                qc_iarg_push(&a);
 }
 
 /*
- * Get internal function parameters.
- * Since there is no user declarartion of the function, we get the
- * parameters in a way similar to get_uparams()
+ * Get internal function parameters. Since there is no user declaration
+ * of the function, each one is stored with the type of its expression.
  */
-static int qc_get_iargs_from_ufunc(void)
+static void qc_get_iargs_from_ufunc(void)
 {
-        Atom var;
-        int count;
-        Atom params[NUM_PARAMS];
-        Atom *v;
+        Atom a;
 
         qc_lex();
         if (QC_TOK(qc_token) != QC_OPENPAREN)
                 qcsyntax(QCE_PAREN_EXPECTED);
 
         /* proces a comma-separacted list of values */
-        v = &params[0];
-        count = 0;
         do {
                 qc_lex();
 
                 if (QC_TOK(qc_token) == QC_STRING) {
-                        /* Get string, push on stack */
-                        v->a_type = qc_token | QC_PTR;
-                        v->a_value.p = qc_token_string;
+                        a.a_type = QC_CHARPTR;
+                        a.a_value.p = qc_token_string;
                 } else if (QC_TOK(qc_token) == QC_CLOSEPAREN) {
-                        /* Break before incrementing count. We're done */
+                        /* We're done */
                         break;
                 } else {
                         qcputback();
-                        qcexpression(&var);
-                        /* save temporarily */
-                        memcpy(v, &var, sizeof(Atom));
+                        qcexpression(&a);
                 }
-
+                qc_iarg_push(&a);
                 qc_lex();
-                ++count;
-                ++v;
-                if (count == NUM_PARAMS)
-                        qcsyntax(QCE_SYNTAX);
         } while (QC_TOK(qc_token) == QC_COMMA);
 
         if (QC_TOK(qc_token) != QC_CLOSEPAREN)
                 qcsyntax(QCE_UNBAL_PARENS);
+}
+
+/*
+ * Helper to qc_register_native(). Check that `t' is a type that a
+ * native's parameter, or its return value if `isret' is true, may have,
+ * and add the flags that QC keeps with it.
+ *
+ * Return: The type, or zero if it is no good. Structs are not
+ * supported, since their types belong to the file that declares them.
+ */
+static qctoken_t native_type(qctoken_t t, int isret)
+{
+        qctoken_t tok = QC_TOK(t);
 
-        /* now, push on qc_lvar_stack in reverse order */
-        --v;
-        qc_iarg_push(v, count);
-        return count;
+        if ((t & ~(QC_TOK_MASK | QC_PTR | QC_UNSIGNED | QC_FLTFLG
+                   | QC_VDFLG | QC_TYPE)) != 0
+            || tok < QC_CHAR || tok > QC_VOID)
+                return 0;
+        if (tok == QC_VOID) {
+                if (!QC_ISPTR(t) && !isret)
+                        return 0;
+                t |= QC_VDFLG;
+        } else if ((tok == QC_DBL || tok == QC_FLT) && !QC_ISPTR(t)) {
+                t |= QC_FLTFLG;
+        }
+        return t & ~QC_TYPE;
 }
 
 /*
- * Call routine for internal functions. This does not save stack
- * pointers, because we will not permit library calls that call
- * back to user-defined calls.
+ * Helper to qc_ifunc_call(). Cast the arguments of a call to a native
+ * (see qc_register_native()) to the types of its parameters, like an
+ * assignment does.
  */
-static void qc_ifunc_call(Atom *ret, struct Function *fn)
+static void native_args(Function *fn, Atom *args, int nargs)
 {
-        int nargs;
+        const struct qc_param_t *p = fn->f_params;
+        Atom a;
+        int i;
 
-        if (qc_namespace == NULL)
-                nargs = qc_get_iargs_from_minibuf();
-        else
-                nargs = qc_get_iargs_from_ufunc();
+        for (i = 0; i < nargs; ++i, ++p) {
+                a = args[i];
+                if (QC_ISPTR(p->p_type) != QC_ISPTR(a.a_type)
+                    && !(QC_ISPTR(p->p_type) && a.a_value.p == NULL))
+                        qcsyntax(QCE_TYPE_MISMATCH);
+                if (QC_ISPTR(p->p_type) && QC_ISPTR(a.a_type)
+                    && !QC_ISVOID(p->p_type & ~QC_PTR)
+                    && !QC_ISVOID(a.a_type & ~QC_PTR)
+                    && QC_TYPEOF(p->p_type) != QC_TYPEOF(a.a_type))
+                        qcsyntax(QCE_TYPE_MISMATCH);
+                args[i].a_type = p->p_type;
+                if (QC_ISPTR(p->p_type))
+                        args[i].a_value.p = a.a_value.p;
+                else
+                        qc_mov(&args[i], &a);
+        }
+}
+
+/*
+ * Call internal function `fn' with the arguments on qc_iarg_stack from
+ * index `base' up, and pop them.
+ */
+static void qc_ifunc_run(Atom *ret, Function *fn, int base)
+{
+        int nargs = qc_iarg_tos - base;
 
-        if (nargs < fn->f_minargs || nargs > fn->f_maxargs)
+        if (nargs < fn->f_minargs
+            || (fn->f_maxargs != QC_VARARGS && nargs > fn->f_maxargs))
                 qcsyntax(QCE_ARG_EXPECTED);
+        if (fn->f_params != NULL)
+                native_args(fn, &qc_iarg_stack[base], nargs);
         ret->a_type = fn->f_ret;
-        fn->f_fn.i(ret);
+        fn->f_fn.i(&qc_iarg_stack[base], nargs, ret);
 
-        /* Clear args for next call */
-        qc_iarg_tos = 0;
+        qc_iarg_tos = base;
 }
 
 /*
- * Call routine for external functions.
+ * Call routine for internal functions. The arguments are evaluated
+ * straight onto qc_iarg_stack, in order, and the function gets them
+ * where they are. An internal function called while the arguments are
+ * evaluated, eg `printf("%d", f(x))', or by the function itself (see
+ * qc_call_function()), stacks its own above them, and pops them again
+ * before returning.
  */
-static void qc_ufunc_call(Atom *ret, Function *fn)
+static void qc_ifunc_call(Atom *ret, struct Function *fn)
 {
-        char *loc, *progsave;
-        int lvartemp;
+        int base = qc_iarg_tos;
+
+        if (qc_namespace == NULL)
+                qc_get_iargs_from_minibuf();
+        else
+                qc_get_iargs_from_ufunc();
+        qc_ifunc_run(ret, fn, base);
+}
+
+/*
+ * Run user function `fn', whose arguments have been pushed onto the
+ * local variable stack from index `lvartemp' up, and pop them. The
+ * caller's program counter is saved and restored.
+ */
+static void qc_ufunc_run(Atom *ret, Function *fn, int lvartemp)
+{
+        char *progsave;
         Namespace *nssave;
 
         /* Save the namespace because the new function might be
          * from a different loaded program. */
         nssave = qc_namespace;
         qc_namespace = fn->f_namespace;
-
-        loc = fn->f_fn.u;
-
-        /*
-         * Temporary stack pointer lvartemp is used, because
-         * of the possibility of recursive function calls to this
-         * function in the argument evaluation (from qc_push_uargs())
-         * or function processing (from qc_interpret_block())
-         *
-         *   lvartemp is the saved local variable stack pointer
-         *   progsave is the saved program counter (IE the link
-         * register for returning from a function).
-         *   loc is the start of the function (the bransh address)
-         */
-        lvartemp = qc_lvar_tos;
-
-        /* Check environment by checking if old namespace was NULL.
-         * If it was, then the call was from qc_execute -- a call
-         * from the command interpreter, not from QC. */
-        if (nssave == NULL)
-                qc_push_uargs_from_minibuf();
-        else
-                qc_push_uargs();
-
         progsave = qc_program_counter;
         qc_ufunc_push(lvartemp);
-        qc_program_counter = loc;
-        qc_get_uparams();
+        qc_name_uparams(fn, lvartemp);
+        qc_program_counter = fn->f_fn.u;
 
         /* XXX: User could possibly `break' from this rather than
          * return */
@@ -333,160 +404,319 @@ static void qc_ufunc_call(Atom *ret, Function *fn)
 
 
 /*
- *                qc_push_uargs() and qc_get_uparams()
+ *                      Memoization of `pure' functions
  *
- * qc_push_uargs() makes a local_push() call like qc_decl_local(), except
- * that the arguments pushed onto the stack have (or should have) been
- * initialized already.
+ * A function declared `pure', `int f(int x) pure { ... }', promises that
+ * what it returns depends on nothing but its arguments, and that it does
+ * nothing else. So each one keeps a table of QC_MEMO_SIZE calls it made,
+ * indexed by a hash of their arguments, as cast to its parameters'
+ * types. A call with the same arguments as one in the table returns what
+ * that one did without running the function; any other call replaces
+ * what was in its slot.
  *
- * qc_get_uparams() links to those arguments before the call to
- * qc_interpret_block(). Since qc_push_uargs() simply copied them onto
- * the stack, there is no need for the stack pointer to move, until
- * local variables are declared; this also means that qc_get_uparams()
- * method of linking the arguments into the new function is to simply
- * write over the variable names; this is also the reason that stack
- * unwinding is not needed. Instead, the local variable stack is reset
- * each time a function returns.
+ * A pointer argument would be compared by its address, not by what it
+ * points at, which may have changed since. So a function with a pointer
+ * parameter gets no table, and every call to it runs.
+ */
+
+/*
+ * struct qc_memo_t - A remembered call to a `pure' function
+ * @m_used: Nonzero once the entry has been filled in
+ * @m_ret: What the call returned
+ * @m_args: Its arguments, as memo_key() made them
+ */
+struct qc_memo_t {
+        int m_used;
+        Atom m_ret;
+        Atom m_args[];
+};
+
+/* Size of a `struct qc_memo_t' for a function of `nargs' parameters */
+static inline size_t memo_size(int nargs)
+{
+        return sizeof(struct qc_memo_t) + nargs * sizeof(Atom);
+}
+
+/*
+ * Get the value of the argument in local variable stack slot `i' into
+ * `k', with the unused bytes of its a_value zeroed, so that it can be
+ * compared and hashed by a_value.ulli.
+ */
+static void memo_key(Atom *k, int i)
+{
+        Variable *v = qc_lvar_at(i);
+
+        qc_load(k, &v->v_datum.a_value, v->v_type);
+}
+
+/*
+ * Find the slot in `fn''s table for a call with the arguments pushed
+ * from local variable stack index `lvartemp' up, and get them into `key'.
+ */
+static struct qc_memo_t *memo_slot(Function *fn, int lvartemp, Atom *key)
+{
+        unsigned long long h = 0;
+        int i;
+
+        for (i = 0; i < fn->f_maxargs; ++i) {
+                memo_key(&key[i], lvartemp + i);
+                h = (h ^ key[i].a_value.ulli) * 0x9E3779B97F4A7C15ULL;
+        }
+        return (struct qc_memo_t *)((char *)fn->f_memo
+                        + (h >> 32) % QC_MEMO_SIZE * memo_size(fn->f_maxargs));
+}
+
+/* True if `m' is a call with arguments `key' */
+static int memo_match(const struct qc_memo_t *m, const Atom *key, int nargs)
+{
+        int i;
+
+        if (!m->m_used)
+                return 0;
+        for (i = 0; i < nargs; ++i) {
+                if (m->m_args[i].a_value.ulli != key[i].a_value.ulli)
+                        return 0;
+        }
+        return 1;
+}
+
+/*
+ * Run user function `fn', whose arguments have been pushed from local
+ * variable stack index `lvartemp' up, or return what a `pure' one
+ * returned for the same arguments before. Once it is hot, a function
+ * whose body is a single `return' is evaluated inline.
  */
+static void qc_ufunc_exec(Atom *ret, Function *fn, int lvartemp)
+{
+        struct qc_memo_t *m = NULL;
+        Atom key[NUM_PARAMS];
+
+        if (fn->f_memo != NULL) {
+                m = memo_slot(fn, lvartemp, key);
+                if (memo_match(m, key, fn->f_maxargs)) {
+                        ++qc_stats.s_memo_hit;
+                        *ret = m->m_ret;
+                        qc_lvar_tos = lvartemp;
+                        return;
+                }
+                ++qc_stats.s_memo_miss;
+        }
 
-/* XXX: these functions should check number of arguments. */
+        if (fn->f_inline != NULL && fn->f_ncalls > QC_INLINE_HOT
+            && qc_namespace != NULL)
+                qc_ufunc_inline(ret, fn, lvartemp);
+        else
+                qc_ufunc_run(ret, fn, lvartemp);
+
+        /* Fill in the whole slot, which a recursive call may have
+         * used in the meantime */
+        if (m != NULL) {
+                m->m_ret = *ret;
+                memcpy(m->m_args, key, fn->f_maxargs * sizeof(Atom));
+                m->m_used = 1;
+        }
+}
 
 /*
- * Push, uargs, push!
+ * Call routine for external functions.
+ */
+static void qc_ufunc_call(Atom *ret, Function *fn)
+{
+        int lvartemp;
+
+        ++fn->f_ncalls;
+
+        /*
+         * Temporary stack pointer lvartemp is used, because
+         * of the possibility of recursive function calls to this
+         * function in the argument evaluation (from qc_push_uargs())
+         * or function processing (from qc_interpret_block())
+         */
+        lvartemp = qc_lvar_tos;
+
+        /* Check environment by checking if old namespace was NULL.
+         * If it was, then the call was from qc_execute -- a call
+         * from the command interpreter, not from QC. Arguments belong
+         * to the caller's namespace, so qc_ufunc_run() only switches
+         * once they have been evaluated. */
+        if (qc_namespace == NULL)
+                qc_push_uargs_from_minibuf(fn);
+        else
+                qc_push_uargs(fn);
+        qc_ufunc_exec(ret, fn, lvartemp);
+}
+
+/**
+ * qc_call_function - Call a function from C, while a QC program is
+ * running.
+ * @fn: The function, eg from qc_func_lookup(). It may be a user function
+ *      or an internal one.
+ * @args: Its arguments, which are cast to its parameters' types, like
+ *      in a call from QC
+ * @nargs: Number of arguments
+ * @ret: Where to store the return value
  *
- * Finish up pushing arguments onto the user function stack.
- * common to qc_push_uargs_from_minibuf() and qc_push_uargs()
+ * This is for internal functions that call back into the program, such
+ * as qsort() with a user's comparison function. It may be called any
+ * number of levels deep: the function's arguments and frame are pushed
+ * above those of the call that is running, and the parser's place in
+ * the program is kept and put back. An error in the function does not
+ * return here; it ends the program, like any other error.
  */
-static void qc_push_uargs_push(Variable *top, int count)
+void qc_call_function(Function *fn, Atom *args, int nargs, Atom *ret)
 {
-        while (count > 0) {
-                local_push(top);
-                --count;
-                --top;
+        struct qc_program_t buf;
+        int base, i;
+
+        qc_program_save(&buf);
+        if (fn->f_call == qc_ufunc_call) {
+                if (nargs != fn->f_maxargs)
+                        qcsyntax(QCE_ARG_EXPECTED);
+                base = qc_lvar_tos;
+                for (i = 0; i < nargs; ++i)
+                        qc_push_uarg(&fn->f_params[i], &args[i]);
+                ++fn->f_ncalls;
+                qc_ufunc_exec(ret, fn, base);
+        } else {
+                base = qc_iarg_tos;
+                for (i = 0; i < nargs; ++i)
+                        qc_iarg_push(&args[i]);
+                qc_ifunc_run(ret, fn, base);
         }
+        qc_program_restore(&buf);
+}
+
+/*
+ * Call a hot user function whose body is a single `return' statement.
+ *
+ * This does what qc_ufunc_run() does, except that the returned
+ * expression is evaluated directly instead of interpreting the block.
+ */
+static void qc_ufunc_inline(Atom *ret, Function *fn, int lvartemp)
+{
+        char *progsave;
+        Namespace *nssave;
+
+        nssave = qc_namespace;
+        progsave = qc_program_counter;
+        qc_ufunc_push(lvartemp);
+        qc_name_uparams(fn, lvartemp);
+        qc_namespace = fn->f_namespace;
+        qc_program_counter = fn->f_inline;
+
+        qcexpression(ret);
+
+        qc_namespace = nssave;
+        qc_program_counter = progsave;
+        qc_lvar_tos = qc_ufunc_pop();
 }
 
+
+/*
+ *                qc_push_uargs() and qc_name_uparams()
+ *
+ * A user function's parameters are read once, when it is declared (see
+ * qc_ufunc_declare()), and kept in its @f_params. A call evaluates each
+ * argument and stores it straight into the next slot of the local
+ * variable stack, cast to its parameter's type like an assignment, so
+ * the slots become the first variables of the callee's frame. They are
+ * not named until the callee's frame is pushed, so that the parameters
+ * cannot hide the caller's variables of the same names while the later
+ * arguments are evaluated.
+ *
+ * The local variable stack is reset each time a function returns, so
+ * no stack unwinding is needed for the arguments either.
+ */
+
 /*
- * Make sure a variable pushed onto argument stack has all its fields
- * in order, not counting its name, Atom or hash-tabke fields.
+ * Push a slot for `fn''s parameter `p' onto the local variable stack,
+ * and store argument `a' in it.
  */
-static void stackvarinit(Variable *v)
+static void qc_push_uarg(const struct qc_param_t *p, Atom *a)
 {
-        v->v_flag = 0;
-        v->v_aidx = 0;
+        Variable *v;
+
+        v = local_slot("");
+        v->v_type  = p->p_type & ~QC_CONST;
+        v->v_flag  = QC_VFLAG_INITIALIZED;
+        if (QC_ISCONST(p->p_type))
+                v->v_flag |= QC_VFLAG_CONST;
+        v->v_ndim  = 0;
         v->v_asize = 1;
-        v->v_type |= QC_ARG;
+        v->v_array = NULL;
+        qc_mov(&v->v_datum, a);
 }
 
 /*
- * Push a user-defined function's arguments onto the local variable
- * stack. These will be retrieved and renamed by the called user function
- * via qc_get_uparams(). The program counter is at the function call
- * (somewhere in the calling function), pointing to the opening
- * parenthesis, of the argument list.
+ * Push the arguments of a call to user function `fn' onto the local
+ * variable stack. The program counter is at the function call
+ * (somewhere in the calling function), before the opening parenthesis
+ * of the argument list; on return it is past the closing one.
  */
-static void qc_push_uargs(void)
+static void qc_push_uargs(Function *fn)
 {
-        Variable params[NUM_PARAMS];
-        register int count;
-        register Variable *pv;
+        Atom a;
+        int count = 0;
 
         qc_lex();
         if (QC_TOK(qc_token) != QC_OPENPAREN)
                 qcsyntax(QCE_PAREN_EXPECTED);
 
-        /* proces a comma-separacted list of value */
-        count = 0;
-        pv = &params[0];
-        do {
-                /* Note: name of variable is handled by
-                 * qc_get_uparams() below */
-                qcexpression(&pv->v_datum);
-                stackvarinit(pv);
-                qc_lex();
-                ++count;
-                ++pv;
-        } while (QC_TOK(qc_token) == QC_COMMA);
-
-        /* now, push on qc_lvar_stack in reverse order */
-        --pv;
-        qc_push_uargs_push(pv, count);
+        qc_lex();
+        if (QC_TOK(qc_token) != QC_CLOSEPAREN) {
+                qcputback();
+                do {
+                        if (count == fn->f_maxargs)
+                                qcsyntax(QCE_ARG_EXPECTED);
+                        qcexpression(&a);
+                        qc_push_uarg(&fn->f_params[count], &a);
+                        qc_lex();
+                        ++count;
+                } while (QC_TOK(qc_token) == QC_COMMA);
+                if (QC_TOK(qc_token) != QC_CLOSEPAREN)
+                        qcsyntax(QCE_PAREN_EXPECTED);
+        }
+        if (count != fn->f_maxargs)
+                qcsyntax(QCE_ARG_EXPECTED);
 }
 
 /*
- * Similar to qc_push_args, except this gets its arguments from the
+ * Similar to qc_push_uargs, except this gets its arguments from the
  * command interpreter instead of a user program.
  */
-static void qc_push_uargs_from_minibuf(void)
+static void qc_push_uargs_from_minibuf(Function *fn)
 {
-        Variable params[NUM_PARAMS];
-        int res;
-        int count;
-        Variable *pv;
+        Atom a;
+        int count = 0;
 
-        pv = &params[0];
-        count = 0;
-        while ((res = token_next_atom(&pv->v_datum)) != 0
-               && count < NUM_PARAMS) {
-                stackvarinit(pv);
-                ++pv;
+        while (token_next_atom(&a) != 0) {
+                if (count == fn->f_maxargs)
+                        qcsyntax(QCE_ARG_EXPECTED);
+                qc_push_uarg(&fn->f_params[count], &a);
                 ++count;
         }
-
-        /* now, push on qc_lvar_stack in reverse order */
-        --pv;
-        qc_push_uargs_push(pv, count);
+        if (count != fn->f_maxargs)
+                qcsyntax(QCE_ARG_EXPECTED);
 }
 
 /*
- * Get a user-defined function's paramters.
- *
- * The program counter is in the function prototype, at the type
- * declaration of the first parameter, or at the closing parenthesis
- * if there are no arguments. (This may change when the `void' key-
- * word gets enabled.
+ * Name the arguments of a call to `fn', pushed from local variable
+ * stack index `i' up, after its parameters. The callee's frame has been
+ * pushed.
  */
-static void qc_get_uparams(void)
+static void qc_name_uparams(Function *fn, int i)
 {
-        Variable *p;
-        qctoken_t type;
-        int i;
-
-        i = qc_lvar_tos - 1;
-        /* Some of the syntax checks are skipped here because they
-         * should have been trapped when the function was declared */
-        do {
-                p = &qc_lvar_stack[i];
-                type = qc_get_type();
-                if (QC_ISVOID(type)) {
-                        while (QC_TOK(qc_token) != QC_CLOSEPAREN)
-                                qc_lex();
-                        break;
-                }
-                p->v_type = QC_TYPEOF(qc_token);
-
-                /* Argument was evaluated in qc_push_uargs */
-                p->v_flag |= QC_VFLAG_INITIALIZED;
-                qc_lex();
-
-                /* link parameter name with argument on local var stack,
-                 * by simply renaming the varaibles on the stack. This is
-                 * okay because: they are newly copied already by
-                 * qc_push_uargs(); and qc_get_uparams() is called before
-                 * the block is interpreted, so there is no fear of
-                 * unwinding args at the wrong place. */
-                strcpy(p->v_name, qc_token_string);
-                qc_lex();
-                --i;
-        } while (QC_TOK(qc_token) == QC_COMMA);
+        const struct qc_param_t *p;
+        int n;
 
-        if (QC_TOK(qc_token) != QC_CLOSEPAREN)
-                qcsyntax(QCE_PAREN_EXPECTED);
+        for (n = 0, p = fn->f_params; n < fn->f_maxargs; ++n, ++p, ++i)
+                memcpy(qc_lvar_name(i), p->p_name, sizeof(p->p_name));
 }
 
 /*
  * Pop a user-defined function's local variables from the
- * local variable stack.
+ * local variable stack. Its local arrays are popped from the local
+ * array data stack as well.
  * Returns index of local variable stack.
  */
 static int qc_ufunc_pop(void)
@@ -495,7 +725,9 @@ static int qc_ufunc_pop(void)
         if (qc_func_tos < 0)
                 qcsyntax(QCE_RET_NOCALL);
 
-        return qc_func_stack[qc_func_tos];
+        qc_ldata_tos = qc_func_stack[qc_func_tos].fr_ldata;
+        local_heap_unwind(qc_func_stack[qc_func_tos].fr_lheap);
+        return qc_func_stack[qc_func_tos].fr_lvar;
 }
 
 /*
@@ -509,26 +741,28 @@ static int qc_ufunc_pop(void)
  */
 static void qc_ufunc_push(int i)
 {
-        if (qc_func_tos > NUM_FUNC)
+        struct qc_frame_t *frames;
+        int n;
+
+        if (qc_func_tos >= qc_func_max)
                 qcsyntax(QCE_NEST_FUNC);
+        if (qc_func_tos == qc_func_nframe) {
+                n = qc_func_nframe == 0 ? 64 : qc_func_nframe * 2;
+                if (n > qc_func_max)
+                        n = qc_func_max;
+                frames = realloc(qc_func_stack, n * sizeof(*frames));
+                if (frames == NULL)
+                        qcsyntax(QCE_NOMEM);
+                qc_func_stack = frames;
+                qc_func_nframe = n;
+        }
 
-        qc_func_stack[qc_func_tos] = i;
+        qc_func_stack[qc_func_tos].fr_lvar = i;
+        qc_func_stack[qc_func_tos].fr_ldata = qc_ldata_tos;
+        qc_func_stack[qc_func_tos].fr_lheap = qc_lheap;
         ++qc_func_tos;
 }
 
-/* Helper to qc_func_lookup() below */
-static Function *qc_func_lookup1(const char *name, Function *t, hash_t hash)
-{
-        while (t != NULL) {
-                if (t->f_hash == hash) {
-                        if (!strcmp(t->f_name, name))
-                                return t;
-                }
-                t = t->f_next;
-        }
-        return t;
-}
-
 /**
  * qc_func_lookup - Find a function with a matching name.
  *
@@ -538,52 +772,51 @@ static Function *qc_func_lookup1(const char *name, Function *t, hash_t hash)
 Function *qc_func_lookup(const char *name)
 {
         hash_t hash;
-        int hidx;
         Function *t;
 
         hash = qc_symbol_hash(name);
 
         /* Static functions have namespace priority */
         if (qc_namespace != NULL) {
-                hidx = hash % NUM_STATIC_FUNC;
-                t = &qc_namespace->fn_hashtbl[hidx];
-                t = qc_func_lookup1(name, t, hash);
+                t = qc_symtab_lookup(&qc_namespace->fn_tab, name, hash);
                 if (t != NULL)
                         return t;
         }
-        hidx = hash % NUM_FUNC;
-        t = &qc_function_hashtbl[hidx];
-        return qc_func_lookup1(name, t, hash);
+        return qc_symtab_lookup(&qc_function_tab, name, hash);
 }
 
 
 /**
  * qc_function_init - Initialize everything in qcfunction.c that needs to
  * be initialized.
+ * @cfg: Run-time limits, or NULL for the defaults
  *
  * Return: zero if everything initialized, or the negative of an error
  * code if not. This function will return early on the first
  * failure.
  */
-int qc_function_init(void)
+int qc_function_init(const struct qc_config_t *cfg)
 {
         /* initialize the hash table while we're in here */
         int ret = 0;
         Function *t;
-        Variable *v;
 
-        for (t = &qc_function_hashtbl[0];
-             t < &qc_function_hashtbl[NUM_FUNC]; ++t) {
-                qc_function_hashinit1(t);
+        qc_lvar_max = NUM_LOCAL_VARS;
+        if (cfg != NULL && cfg->c_max_lvars != 0) {
+                qc_lvar_max = cfg->c_max_lvars > INT_MAX
+                              ? INT_MAX : (int)cfg->c_max_lvars;
         }
-        for (v = &qc_gvar_hashtbl[0];
-             v < &qc_gvar_hashtbl[NUM_GLOBAL_VARS]; ++v) {
-                qc_gvar_hashinit1(v);
+        qc_func_max = NUM_FUNC;
+        if (cfg != NULL && cfg->c_max_depth != 0) {
+                qc_func_max = cfg->c_max_depth > INT_MAX
+                              ? INT_MAX : (int)cfg->c_max_depth;
         }
 
-        /* Install internal functions while we're at it */
+        /* Install internal functions while we're at it. They do not
+         * belong to any Namespace, so they are not copied. */
         for (t = qc_ifunc_tbl; *t->f_name != '\0'; ++t) {
-                ret = qc_insert_fn(t);
+                ret = qc_symtab_insert(&qc_function_tab, t->f_name,
+                                       qc_symbol_hash(t->f_name), t);
                 if (ret)
                         goto done;
         }
@@ -591,18 +824,81 @@ done:
         return ret;
 }
 
-void qc_function_namespace_init(Namespace *ns)
+/**
+ * qc_register_native - Add an internal function written in C by the
+ * program that QC is embedded in.
+ * @name: Name that scripts call it by
+ * @fn: The function. It is called like the built-in ones (see union
+ *      function_cb_t), with its arguments already cast to @arg_types.
+ * @ret_type: Type of its return value, eg QC_INT, QC_VOID or QC_CHARPTR
+ * @arg_types: Type of each of its parameters. A pointer parameter only
+ *      takes a pointer to the same type, or a `void' pointer.
+ * @nargs: Number of parameters
+ *
+ * This is called after qc_init(), and before loading any file that
+ * calls the function. It lasts until QC is cleaned up.
+ *
+ * Return: Zero, or the negative of an error code: QCE_NAMES_MATCH if
+ * there is a function named @name already, or QCE_PARAM_ERR if one of
+ * the other arguments is no good.
+ */
+int qc_register_native(const char *name,
+                       void (*fn)(Atom *args, int nargs, Atom *ret),
+                       qctoken_t ret_type, const qctoken_t arg_types[],
+                       int nargs)
 {
-        Function *t;
-        Variable *v;
-        for (t = &ns->fn_hashtbl[0];
-             t < &ns->fn_hashtbl[NUM_STATIC_FUNC]; ++t) {
-                qc_function_hashinit1(t);
+        struct qc_native_t *nat;
+        Function *f;
+        qctoken_t type;
+        int i;
+
+        if (name == NULL || *name == '\0' || strlen(name) > ID_LEN
+            || fn == NULL || nargs < 0 || nargs > NUM_PARAMS
+            || (nargs > 0 && arg_types == NULL))
+                return -QCE_PARAM_ERR;
+        if (qc_symtab_lookup(&qc_function_tab, name,
+                             qc_symbol_hash(name)) != NULL)
+                return -QCE_NAMES_MATCH;
+
+        nat = calloc(1, sizeof(*nat) + nargs * sizeof(nat->n_params[0]));
+        if (nat == NULL)
+                return -QCE_NOMEM;
+        f = &nat->n_fn;
+        strcpy(f->f_name, name);
+        f->f_fn.i = fn;
+        f->f_call = qc_ifunc_call;
+        f->f_minargs = nargs;
+        f->f_maxargs = nargs;
+        f->f_params = nargs > 0 ? nat->n_params : NULL;
+
+        type = native_type(ret_type, 1);
+        for (i = 0; i < nargs && type != 0; ++i) {
+                nat->n_params[i].p_type = native_type(arg_types[i], 0);
+                if (nat->n_params[i].p_type == 0)
+                        type = 0;
+        }
+        if (type == 0) {
+                free(nat);
+                return -QCE_PARAM_ERR;
         }
-        for (v = &ns->var_hashtbl[0];
-             v < &ns->var_hashtbl[NUM_STATIC_VARS]; ++v) {
-                qc_gvar_hashinit1(v);
+        f->f_ret = type | QC_TYPE;
+
+        if (qc_symtab_insert(&qc_function_tab, f->f_name,
+                             qc_symbol_hash(f->f_name), f)) {
+                free(nat);
+                return -QCE_NOMEM;
         }
+        nat->n_next = qc_natives;
+        qc_natives = nat;
+        return 0;
+}
+
+void qc_function_namespace_init(Namespace *ns)
+{
+        memset(&ns->fn_tab, 0, sizeof(ns->fn_tab));
+        memset(&ns->var_tab, 0, sizeof(ns->var_tab));
+        ns->var_seg = NULL;
+        ns->var_nseg = 0;
 }
 
 /**
@@ -612,31 +908,10 @@ void qc_function_namespace_init(Namespace *ns)
  */
 void qc_function_namespace_exit(Namespace *ns)
 {
-        Function *t, *p, *q;
-        Variable *x, *y, *z;
-
-        for (t = &ns->fn_hashtbl[0];
-             t < &ns->fn_hashtbl[NUM_STATIC_FUNC]; ++t) {
-                p = t->f_next;
-                while (p != NULL) {
-                        q = p;
-                        p = p->f_next;
-                        free(q);
-                }
-                qc_function_hashinit1(t);
-        }
-
-        for (x = &ns->var_hashtbl[0];
-             x < &ns->var_hashtbl[NUM_STATIC_VARS]; ++x) {
-                /* TODO: Same issues as with qc_function exit here */
-                y = x->v_next;
-                while (y != NULL) {
-                        z = y;
-                        y = y->v_next;
-                        free(z);
-                }
-                qc_gvar_hashinit1(x);
-        }
+        /* The functions and variables themselves are freed with the
+         * rest of the Namespace's arena */
+        qc_symtab_free(&ns->fn_tab);
+        qc_symtab_free(&ns->var_tab);
 }
 
 
@@ -646,33 +921,29 @@ void qc_function_namespace_exit(Namespace *ns)
  */
 void qc_function_exit(void)
 {
-        Function *t, *p, *q;
-        Variable *x, *y, *z;
+        struct qc_native_t *nat;
 
-        for (t = &qc_function_hashtbl[0];
-             t < &qc_function_hashtbl[NUM_FUNC]; ++t) {
-                p = t->f_next;
-                while (p != NULL) {
-                        q = p;
-                        p = p->f_next;
-                        free(q);
-                }
-                qc_function_hashinit1(t);
+        qc_symtab_free(&qc_function_tab);
+        qc_symtab_free(&qc_gvar_tab);
+        while ((nat = qc_natives) != NULL) {
+                qc_natives = nat->n_next;
+                free(nat);
         }
 
-        for (x = &qc_gvar_hashtbl[0];
-             x < &qc_gvar_hashtbl[NUM_GLOBAL_VARS]; ++x) {
-                /* TODO: More than this: every variable needs to be
-                 * checked if it has a data array, and cleared if it
-                 * does */
-                y = x->v_next;
-                while (y != NULL) {
-                        z = y;
-                        y = y->v_next;
-                        free(z);
-                }
-                qc_gvar_hashinit1(x);
-        }
+        /* In case we got here from an error in a function call */
+        local_heap_unwind(NULL);
+        qc_lvar_tos = 0;
+        qc_ldata_tos = 0;
+        qc_func_tos = 0;
+        qc_iarg_tos = 0;
+
+        while (qc_lvar_nseg > 0)
+                free(qc_lvar_seg[--qc_lvar_nseg]);
+        free(qc_lvar_seg);
+        qc_lvar_seg = NULL;
+        free(qc_func_stack);
+        qc_func_stack = NULL;
+        qc_func_nframe = 0;
 }
 
 /**
@@ -680,117 +951,71 @@ void qc_function_exit(void)
  * @f: Pointer to the function's descriptor struct. If `f' is
  *      static, then the function will be inserted into the current
  *      namespace's hash table; otherwise it will be inserted into the
- *      global hash table.
+ *      global hash table. It is copied into the current namespace's
+ *      arena.
  *
  * This is called during prescan.
  *
- * Return: Zero if the function was inserted; a negative number if
- * a symbol with the same name has already been installed.
+ * Return: Zero if the function was inserted, or the negative of an
+ * error code. If a function with the same name was inserted already,
+ * `f' replaces it.
  */
 int qc_insert_fn(Function *f)
 {
-        Function *t, *new;
+        struct qc_symtab_t *st;
+        Function *t;
         hash_t hash = qc_symbol_hash(f->f_name);
-        int hidx;
 
-        if (QC_ISSTATIC(f->f_ret)) {
-                hidx = hash % NUM_STATIC_FUNC;
-                t = &qc_namespace->fn_hashtbl[hidx];
-        } else {
-                hidx = hash % NUM_FUNC;
-                t = &qc_function_hashtbl[hidx];
-        }
+        if (QC_ISSTATIC(f->f_ret))
+                st = &qc_namespace->fn_tab;
+        else
+                st = &qc_function_tab;
 
-        if (t->f_hash == -1 || t->f_hash == hash) {
-                /* XXX: If t->f_hash == hash, then
-                 * there is a duplicate-symbol error */
-                memcpy(t, f, sizeof(Function));
-                t->f_hash = hash;
-                t->f_next = NULL;
-                return 0;
-        }
-        new = malloc(sizeof(Function));
-        if (new == NULL)
+        t = qc_arena_alloc(&qc_namespace->arena, sizeof(Function));
+        if (t == NULL)
                 return -QCE_NOMEM;
-        memcpy(new, f, sizeof(Function));
-        new->f_hash = hash;
-        qc_fn_collision_insert(new, t);
-        return 0;
+        memcpy(t, f, sizeof(Function));
+        /* XXX: If `f' replaces a function, that is a duplicate-symbol
+         * error */
+        return qc_symtab_insert(st, t->f_name, hash, t);
 }
 
-static int qc_gvar_insert(Variable *v)
+/*
+ * Insert global or static variable `v' named `name'. `v' is copied into
+ * the current namespace's storage.
+ *
+ * Return: Pointer to the inserted variable, or NULL if out of memory
+ */
+static Variable *qc_gvar_insert(const char *name, Variable *v)
 {
-        Variable *t, *new;
-        hash_t hash = qc_symbol_hash(v->v_name);
-        int hidx = hash;
-        if (QC_ISSTATIC(v->v_type)) {
-                hidx = hash % NUM_STATIC_VARS;
-                t = &qc_namespace->var_hashtbl[hidx];
-        } else {
-                hidx = hash % NUM_GLOBAL_VARS;
-                t = &qc_gvar_hashtbl[hidx];
-        }
-        if (t->v_hash == -1 || t->v_hash == hash) {
-                memcpy(t, v, sizeof(Variable));
-                t->v_hash = hash;
-                t->v_next = NULL;
-                return 0;
-        }
-        new = malloc(sizeof(Variable));
-        if (new == NULL)
-                return -QCE_NOMEM;
-        memcpy(new, v, sizeof(Variable));
-        new->v_hash = hash;
-        qc_gvar_collision_insert(new, t);
-        return 0;
-}
-
-static void qc_gvar_collision_insert(Variable *new, Variable *root)
-{
-        Variable *old;
-
-        old = root;
-        while (root != NULL) {
-                old = root;
-                root = root->v_next;
-        }
-        old->v_next = new;
-        new->v_next = NULL;
-}
-
-static void qc_fn_collision_insert(Function *new, Function *root)
-{
-        Function *old;
+        Namespace *ns = qc_namespace;
+        struct qc_symtab_t *st;
+        struct qc_gvar_seg_t *seg;
+        Variable *t;
+        hash_t hash = qc_symbol_hash(name);
+        int i;
 
-        old = root;
-        while (root != NULL) {
-                old = root;
-                root = root->f_next;
+        if (QC_ISSTATIC(v->v_type))
+                st = &qc_namespace->var_tab;
+        else
+                st = &qc_gvar_tab;
+
+        if (ns->var_seg == NULL || ns->var_nseg == QC_SYM_SEGSIZE) {
+                seg = qc_arena_alloc(&ns->arena, sizeof(*seg));
+                if (seg == NULL)
+                        return NULL;
+                ns->var_seg = seg;
+                ns->var_nseg = 0;
         }
-        old->f_next = new;
-        new->f_next = NULL;
-}
-
-/**
- * iarg_pop - Get next argument from the internal argument stack.
- *
- * Note: This is for the internal `library' functions to use.
- *
- * If a string is expected, the argument should be a pointer. Use the
- * .p field of a_value.
- *
- * Return: Pointer to the argument, or NULL if there are no more
- * parameters. This is a bug: either qc_ifunc_tbl in qcparse.c is wrong,
- * or you are asking for too many arguments.
- *
- * Warning: Retun value is valid only until you exit the function.
- */
-Atom *iarg_pop(void)
-{
-        --qc_iarg_tos;
-        if (qc_iarg_tos < 0)
-                qcsyntax(QCE_TOO_MANY_ARGS);
-        return &qc_iarg_stack[qc_iarg_tos];
+        i = ns->var_nseg;
+        seg = ns->var_seg;
+        t = &seg->gs_var[i];
+        memcpy(t, v, sizeof(Variable));
+        strcpy(seg->gs_name[i], name);
+        if (qc_symtab_insert(st, seg->gs_name[i], hash, t))
+                return NULL;
+        ++ns->var_nseg;
+        return t;
 }
 
 /**
@@ -815,6 +1040,45 @@ void qc_ufunc_ret(void)
 
 /* WRONG WRONG WRONG WRONG WRONG */
 
+/*
+ * Helper to qc_ufunc_declare(). The program counter is just past the
+ * closing parenthesis of a function's parameter list.
+ *
+ * Return: If the function body is nothing but `return <expr>;', and
+ * <expr> does not call function `name' itself, a pointer to <expr>.
+ * Otherwise NULL. The program counter is left where it was found.
+ */
+static char *qc_ufunc_inline_expr(const char *name)
+{
+        char *pc = qc_program_counter;
+        char *expr = NULL;
+
+        if (QC_TOK(qc_lex()) != QC_OPENBR || QC_TOK(qc_lex()) != QC_RETURN)
+                goto done;
+
+        expr = qc_program_counter;
+        do {
+                qc_lex();
+                switch (QC_TOK(qc_token)) {
+                case QC_IDENTIFIER:
+                        if (strcmp(qc_token_string, name))
+                                break;
+                        /* Fall through, recursive */
+                case QC_OPENBR:
+                case QC_CLOSEBR:
+                case QC_FINISHED:
+                        expr = NULL;
+                        goto done;
+                }
+        } while (QC_TOK(qc_token) != QC_SEMI);
+
+        if (QC_TOK(qc_lex()) != QC_CLOSEBR)
+                expr = NULL;
+done:
+        qc_program_counter = pc;
+        return expr;
+}
+
 /**
  * qc_ufunc_declare - Declare a function.
  *
@@ -825,12 +1089,18 @@ void qc_ufunc_declare(void)
 {
         Function new;
         Function *f = &new;
+        struct qc_param_t params[NUM_PARAMS];
         int args = 0;
+        int i;
         qctoken_t type;
         int ret;
 
         f->f_call = qc_ufunc_call;
         f->f_namespace = qc_namespace;
+        f->f_ncalls = 0;
+        f->f_inline = NULL;
+        f->f_params = NULL;
+        f->f_memo = NULL;
 
         type = qc_get_type();
         if (type == -1)
@@ -840,7 +1110,11 @@ void qc_ufunc_declare(void)
                 type |= QC_PTR;
                 qc_lex();
         }
-        f->f_ret = type;
+        /* Structs are passed and returned by pointer only */
+        if (QC_ISSTRUCT(type))
+                qcsyntax(QCE_TYPE_INVAL);
+        /* A returned value is not a variable, so `const' means nothing */
+        f->f_ret = type & ~QC_CONST;
 
         qc_lex();
 
@@ -850,28 +1124,31 @@ void qc_ufunc_declare(void)
         qc_lex();
         if (QC_TOK(qc_token) != QC_OPENPAREN)
                 qcsyntax(QCE_PAREN_EXPECTED);
-        f->f_fn.u = qc_program_counter;
 
-        ret = qc_insert_fn(f);
-        if (ret)
-                qcsyntax(-ret);
-
-        /* Count args */
+        /* Read the parameters once, for every call to use */
         args = 0;
         do {
                 type = qc_get_type();
-                if (QC_ISVOID(type)) {
-                        /* No args, just skip to closing parenthesis */
-                        while (QC_TOK(qc_token) != QC_CLOSEPAREN)
-                                qc_lex();
-                        break;
-                } else if (!QC_ISTYPE(type)) {
+                if (type == (qctoken_t)-1 || !QC_ISTYPE(type))
                         qcsyntax(QCE_TYPE_EXPECTED);
-                }
-                ++args;
                 qc_lex();
+                if (QC_ISVOID(type) && args == 0
+                    && QC_TOK(qc_token) == QC_CLOSEPAREN) {
+                        /* No args */
+                        break;
+                }
+                type = decl_type(type);
+                /* Structs are passed by pointer only */
+                if (QC_ISSTRUCT(type) || QC_ISVOID(type)
+                    || QC_ISSTATIC(type))
+                        qcsyntax(QCE_TYPE_INVAL);
+                if (args == NUM_PARAMS)
+                        qcsyntax(QCE_TOO_MANY_ARGS);
                 if (QC_TOK(qc_token) != QC_IDENTIFIER)
                         qcsyntax(QCE_IDENTIFIER_EXPECTED);
+                params[args].p_type = type;
+                strcpy(params[args].p_name, qc_token_string);
+                ++args;
 
                 qc_lex();
         } while (QC_TOK(qc_token) == QC_COMMA);
@@ -879,24 +1156,406 @@ void qc_ufunc_declare(void)
         if (QC_TOK(qc_token) != QC_CLOSEPAREN)
                 qcsyntax(QCE_PAREN_EXPECTED);
 
+        /* `pure' is a keyword only here, after the parameter list */
+        f->f_fn.u = qc_program_counter;
+        qc_lex();
+        if (QC_TOK(qc_token) == QC_IDENTIFIER
+            && !strcmp(qc_token_string, "pure")) {
+                f->f_fn.u = qc_program_counter;
+                for (i = 0; i < args && !QC_ISPTR(params[i].p_type); ++i)
+                        ;
+                if (i == args) {
+                        f->f_memo = qc_arena_alloc(&qc_namespace->arena,
+                                        QC_MEMO_SIZE * memo_size(args));
+                        if (f->f_memo == NULL)
+                                qcsyntax(QCE_NOMEM);
+                }
+        }
+        qc_program_counter = f->f_fn.u;
+
         f->f_maxargs = args;
         f->f_minargs = args;
+        if (args > 0) {
+                f->f_params = qc_arena_alloc(&qc_namespace->arena,
+                                             args * sizeof(*params));
+                if (f->f_params == NULL)
+                        qcsyntax(QCE_NOMEM);
+                memcpy(f->f_params, params, args * sizeof(*params));
+        }
+        f->f_inline = qc_ufunc_inline_expr(f->f_name);
+
+        ret = qc_insert_fn(f);
+        if (ret)
+                qcsyntax(-ret);
+}
+
+/*
+ * Helper to qc_decl_global() and qc_decl_local(). `type' is the type
+ * that qc_get_type() returned, and the current token is the first one of
+ * a declarator. Skip the `*' of a pointer, and a `const' after it, if
+ * there are any; on return, the current token is the variable's name.
+ *
+ * Return: The variable's type. QC_CONST is set in it if the variable
+ * itself is read-only, as in `const int x' or `int *const p', but not
+ * `const int *p'; QC does not keep track of what a pointer points at,
+ * so that is the same as `int *p'.
+ */
+static qctoken_t decl_type(qctoken_t type)
+{
+        if (QC_TOK(qc_token) != QC_MULTOK)
+                return type;
+
+        type = (type | QC_PTR) & ~QC_CONST;
+        qc_lex();
+        if (QC_ISCONST(qc_token)) {
+                type |= QC_CONST;
+                qc_lex();
+        }
+        return type;
+}
+
+/*
+ * Helper to qc_decl_global() and qc_decl_local(). The current token is
+ * the first `[' of an array declarator, which has one for each
+ * dimension, eg `m[3][4]'; on return it is the token after the last
+ * `]'. The size of each dimension is stored in `dims', and `v->v_ndim'
+ * is set if there is more than one. `*rowp' is set to the number of
+ * elements in each step of the first dimension (one, unless there are
+ * more dimensions).
+ *
+ * Return: The total number of elements, or zero if the first size is
+ * `[]', in which case the array gets one element, or row, for each value
+ * in its initializer list
+ */
+static size_t decl_array_dims(Variable *v, size_t *dims, size_t *rowp,
+                              unsigned long long max)
+{
+        unsigned long long size, row = 1;
+        int n = 0;
+
+        do {
+                if (n == QC_ARRAY_MAXDIM)
+                        qcsyntax(QCE_ARRAY_TOO_BIG);
+                qc_lex();
+                if (QC_TOK(qc_token) == QC_CLOSESQU && n == 0) {
+                        dims[n++] = 0;
+                        qc_lex();
+                        continue;
+                }
+                if (QC_TOK(qc_token) != QC_NUMBER)
+                        qcsyntax(QCE_ARRAYSIZE_NOT_LIT);
+                size = strtoull(qc_token_string, NULL, 0);
+                if (size > max || (n > 0 && (size == 0 || row > max / size)))
+                        qcsyntax(QCE_ARRAY_TOO_BIG);
+                if (n > 0)
+                        row *= size;
+                dims[n++] = size;
+                qc_lex();
+                if (QC_TOK(qc_token) != QC_CLOSESQU)
+                        qcsyntax(QCE_SQUBRACE_EXPECTED);
+                qc_lex();
+        } while (QC_TOK(qc_token) == QC_OPENSQU);
+
+        if (dims[0] > max / row)
+                qcsyntax(QCE_ARRAY_TOO_BIG);
+        v->v_ndim = n > 1 ? n : 0;
+        *rowp = row;
+        return dims[0] * row;
+}
+
+/*
+ * Helper to qc_decl_global() and qc_decl_local(). Get zeroed storage for
+ * the `size' elements of array or struct `v', from `arena', or from the
+ * local data stack if that is NULL. If the array has more than one
+ * dimension, their sizes, `dims', go in front of the elements.
+ */
+static void array_alloc(Variable *v, size_t size, const size_t *dims,
+                        struct qc_arena_t *arena)
+{
+        size_t hdr = v->v_ndim * sizeof(*dims);
+        size_t nbytes = hdr + size * qc_type_size(v->v_type);
+        char *p;
+
+        if (arena != NULL) {
+                p = qc_arena_alloc(arena, nbytes);
+                if (p == NULL)
+                        qcsyntax(QCE_NOMEM);
+        } else {
+                p = local_alloc(nbytes);
+        }
+        memcpy(p, dims, hdr);
+        v->v_array = p + hdr;
+}
+
+/*
+ * Helper to qc_decl_global() and qc_decl_local(). The current token is
+ * the `=' before an array's initializer list, `{ a, b, ... }', and
+ * `size' is the number of elements the array was declared with, or
+ * zero. Count the values in the list; the program is left where it was
+ * found. `*constp' is set false if any of them uses a variable or calls
+ * a function, so that the list may not have the same value every time.
+ * The list is flat even if the array has more than one dimension; if
+ * `size' is zero, the array gets enough rows of `row' elements to hold
+ * it.
+ *
+ * Return: The number of elements the array gets
+ */
+static size_t init_count(size_t size, size_t row, int *constp)
+{
+        struct qc_program_t buf;
+        size_t n = 0;
+        int paren = 0;
+        int empty = 1;
+
+        qc_program_save(&buf);
+        if (QC_TOK(qc_lex()) != QC_OPENBR)
+                qcsyntax(QCE_ARRAY_INITIALIZER);
+
+        *constp = 1;
+        for (;;) {
+                qc_lex();
+                switch (QC_TOK(qc_token)) {
+                case QC_OPENPAREN:
+                        ++paren;
+                        break;
+                case QC_CLOSEPAREN:
+                        --paren;
+                        break;
+                case QC_COMMA:
+                        if (paren != 0)
+                                break;
+                        if (empty)
+                                qcsyntax(QCE_ARRAY_INITIALIZER);
+                        ++n;
+                        empty = 1;
+                        continue;
+                case QC_IDENTIFIER:
+                        *constp = 0;
+                        break;
+                case QC_CLOSEBR:
+                        /* A comma may follow the last value */
+                        if (!empty)
+                                ++n;
+                        goto done;
+                case QC_OPENBR:
+                case QC_SEMI:
+                case QC_FINISHED:
+                        qcsyntax(QCE_ARRAY_INITIALIZER);
+                        break;
+                }
+                empty = 0;
+        }
+
+done:
+        qc_program_restore(&buf);
+        if (n == 0 || (size != 0 && n > size))
+                qcsyntax(QCE_ARRAY_INITIALIZER);
+        return size != 0 ? size : (n + row - 1) / row * row;
+}
+
+/*
+ * Helper to qc_decl_global() and qc_decl_local(). Store the values of
+ * an initializer list, counted by init_count(), in array `v', whose
+ * other elements are zero already. The current token is the `=' before
+ * the list; on return, it is the token after the `}'.
+ */
+static void array_init(Variable *v)
+{
+        char *elem = v->v_array;
+        size_t esize = qc_type_size(v->v_type);
+        Atom a;
+
+        qc_lex();
+        do {
+                qc_lex();
+                if (QC_TOK(qc_token) == QC_CLOSEBR)
+                        break;
+                qcputback();
+                qcexpression(&a);
+                qc_store(elem, v->v_type, &a);
+                elem += esize;
+        } while (QC_TOK(qc_lex()) == QC_COMMA);
+
+        if (QC_TOK(qc_token) != QC_CLOSEBR)
+                qcsyntax(QCE_ARRAY_INITIALIZER);
+        qc_lex();
+}
+
+/*
+ * Helper to qc_decl_local(). Get storage for local array `v', declared
+ * with `size' elements or with `[]', and with dimensions `dims' (see
+ * decl_array_dims()), and initialize it from the list after the current
+ * token, which is the `='. On return, the current token is the one
+ * after the list's `}'.
+ *
+ * A list of nothing but literals has the same value every time, so it
+ * is evaluated only once; see qc_fold_array(). After that the array
+ * gets a copy of it, or, if it is `const' (`rdonly'), the kept value
+ * itself. The copy includes the sizes of the dimensions, so that a
+ * `[]' is resolved only the first time too.
+ */
+static void local_array_init(Variable *v, size_t size, size_t *dims,
+                             size_t row, int rdonly)
+{
+        const struct qc_fold_t *cf;
+        const char *site;
+        size_t hdr = v->v_ndim * sizeof(*dims);
+        size_t nbytes;
+        char *data;
+        int isconst;
+
+        site = qc_program_counter;
+        while (isspace(*site))
+                ++site;
+        cf = qc_fold_lookup(site);
+        if (cf != NULL) {
+                v->v_asize = cf->cf_count;
+                data = (char *)cf->cf_value.a_value.p - hdr;
+                nbytes = hdr + cf->cf_count * qc_type_size(v->v_type);
+                if (rdonly) {
+                        v->v_array = data + hdr;
+                } else {
+                        v->v_array = (char *)local_alloc(nbytes) + hdr;
+                        memcpy((char *)v->v_array - hdr, data, nbytes);
+                }
+                qc_program_counter = cf->cf_end;
+                qc_lex();
+                return;
+        }
+
+        v->v_asize = init_count(size, row, &isconst);
+        dims[0] = v->v_asize / row;
+        array_alloc(v, v->v_asize, dims, NULL);
+        array_init(v);
+        if (!isconst)
+                return;
+
+        nbytes = hdr + v->v_asize * qc_type_size(v->v_type);
+        data = qc_arena_alloc(&qc_namespace->arena, nbytes);
+        if (data == NULL)
+                qcsyntax(QCE_NOMEM);
+        memcpy(data, (char *)v->v_array - hdr, nbytes);
+        qc_fold_array(site, qc_program_counter_save, v->v_type, data + hdr,
+                      v->v_asize);
+        if (rdonly)
+                v->v_array = data + hdr;
+}
+
+/*
+ * Helper to qc_decl_global() and local_static(). Set up variable `v',
+ * of type `vtype' (see decl_type()), whose storage lasts as long as its
+ * Namespace. It is zero, like in ordinary C. The current token is the
+ * one after the variable's name; on return it is the one after the
+ * array size, if any.
+ */
+static void static_storage(Variable *v, qctoken_t vtype)
+{
+        size_t dims[QC_ARRAY_MAXDIM];
+        size_t size = 1;
+        size_t row;
+        int isconst;
+
+        v->v_type       = vtype & ~QC_CONST;
+        v->v_value.ulli = 0ULL;
+        v->v_flag       = QC_VFLAG_INITIALIZED;
+        v->v_ndim       = 0;
+        v->v_array      = NULL;
+
+        if (QC_TOK(qc_token) == QC_OPENSQU) {
+                v->v_flag |= QC_VFLAG_ARRAY;
+                size = decl_array_dims(v, dims, &row, QC_GARRAY_MAX);
+                if (QC_TOK(qc_token) == QC_EQEQ)
+                        size = init_count(size, row, &isconst);
+                else if (size == 0)
+                        qcsyntax(QCE_ARRAY_INITIALIZER);
+                dims[0] = size / row;
+        }
+        /* A struct's members are stored like array elements */
+        if (QC_ISARRAY(v) || QC_ISSTRUCT(v->v_type))
+                array_alloc(v, size, dims, &qc_namespace->arena);
+        v->v_asize = size;
+}
+
+/*
+ * Helper to qc_decl_global() and local_static(). Initialize `v', set up
+ * by static_storage(), if there is an `=' at the current token. On
+ * return, the current token is the one after the declarator.
+ */
+static void static_init(Variable *v, qctoken_t vtype)
+{
+        Atom a;
+
+        /* If other vars are used, they must be declared already. */
+        if (QC_TOK(qc_token) == QC_EQEQ && QC_ISARRAY(v)) {
+                array_init(v);
+        } else if (QC_TOK(qc_token) == QC_EQEQ) {
+                qcexpression(&a);
+                assign_var_deref(v, &a);
+                qc_lex();
+        }
+        if (QC_ISCONST(vtype))
+                v->v_flag |= QC_VFLAG_CONST;
+}
+
+/*
+ * Helper to qc_decl_local(). Declare `static' variable `name' of type
+ * `vtype', whose name is at `site' in the program buffer. The current
+ * token is the one after the name; on return, it is the one after the
+ * declarator.
+ *
+ * The variable is set up, and its initializer evaluated, only the first
+ * time the function gets here. Like a global, it lasts as long as its
+ * Namespace. After that, the declarator is skipped, see qc_fold_static().
+ * Either way, the name is pushed on the local variable stack, with
+ * QC_VFLAG_STATIC set, so that qc_local_uvar_lookup() finds the variable
+ * through it.
+ */
+static void local_static(const char *name, const char *site,
+                         qctoken_t vtype)
+{
+        const struct qc_fold_t *cf;
+        Variable alias;
+        Variable *v;
+
+        cf = qc_fold_lookup(site);
+        if (cf != NULL) {
+                v = cf->cf_value.a_value.p;
+                qc_program_counter = cf->cf_end;
+                qc_lex();
+        } else {
+                v = qc_arena_alloc(&qc_namespace->arena, sizeof(*v));
+                if (v == NULL)
+                        qcsyntax(QCE_NOMEM);
+                static_storage(v, vtype);
+                static_init(v, vtype);
+                qc_fold_static(site, qc_program_counter_save, v);
+        }
+
+        alias.v_type       = v->v_type;
+        alias.v_value.ulli = 0ULL;
+        alias.v_array      = v;
+        alias.v_asize      = 0;
+        alias.v_flag       = QC_VFLAG_STATIC;
+        alias.v_ndim       = 0;
+        local_push(name, &alias);
 }
 
 /**
  * qc_decl_global - declare a global variable. Part of prescan.
  *
  * The program counter is at the start of the variable type.
+ *
+ * A `const' variable's initializer is the last value it gets. Once the
+ * whole file is scanned, reads of it are folded into the code; see
+ * qc_fold_consts(). An array's initializer list is stored in it here, so
+ * it is evaluated only once.
  */
 void qc_decl_global(void)
 {
-        qctoken_t type;
-        Atom *varray;
+        qctoken_t type, vtype;
         Variable var;
-        Variable *v = &var;
-        int ret;
-        int size;
-        int i;
+        Variable *v;
+        char name[ID_LEN + 1];
 
         type = qc_get_type();
         if (type == -1)
@@ -906,90 +1565,54 @@ void qc_decl_global(void)
 
         do {
                 qc_lex();
-                if (QC_TOK(qc_token) == QC_MULTOK) {
-                        type |= QC_PTR;
-                        qc_lex();
-                } else {
-                        type &= ~QC_PTR;
-                }
+                vtype = decl_type(type);
                 if (QC_TOK(qc_token) != QC_IDENTIFIER)
                         qcsyntax(QCE_IDENTIFIER_EXPECTED);
 
-                strcpy(v->v_name, qc_token_string);
-                v->v_type    = type;
-                v->v_value.i = 0;
-
+                strcpy(name, qc_token_string);
                 qc_lex();
+                static_storage(&var, vtype);
 
-                if (QC_TOK(qc_token) == QC_OPENSQU) {
-                        v->v_flag |= QC_VFLAG_ARRAY;
-
-                        qc_lex();
-                        if (QC_TOK(qc_token) != QC_NUMBER)
-                                qcsyntax(QCE_ARRAYSIZE_NOT_LIT);
-                        size = strtoul(qc_token_string, NULL, 0);
-                        if (size > QC_GARRAY_MAX)
-                                qcsyntax(QCE_ARRAY_TOO_BIG);
-                        qc_lex();
-                        if (QC_TOK(qc_token) != QC_CLOSESQU)
-                                qcsyntax(QCE_SQUBRACE_EXPECTED);
-                        qc_lex();
-                        varray = malloc((size) * sizeof(Atom));
-                        if (varray == NULL)
-                                qcsyntax(QCE_NOMEM);
-                        for (i = 0; i < size; ++i)
-                                varray[i].a_type = type;
-                        v->v_array = varray;
-                } else {
-                        v->v_array = NULL;
-                        size = 1;
-                }
-
-                v->v_asize = size;
-                v->v_aidx  = 0;
-
-                ret = qc_gvar_insert(v);
-                if (ret)
-                        qcsyntax(ret);
-
-                /* Maybe initialization. If other vars are used,
-                 * they must be declared already. */
-                if (QC_TOK(qc_token) == QC_EQEQ) {
-                        Atom a;
-                        if (QC_ISARRAY(v))
-                                qcsyntax(QCE_ARRAY_INITIALIZER);
-
-                        qcexpression(&a);
-                        assign_var(v->v_name, &a);
-                        qc_lex();
-                }
-
+                v = qc_gvar_insert(name, &var);
+                if (v == NULL)
+                        qcsyntax(QCE_NOMEM);
+                static_init(v, vtype);
         } while (QC_TOK(qc_token) == QC_COMMA);
 
         if (QC_TOK(qc_token) != QC_SEMI)
                 qcsyntax(QCE_SEMI_EXPECTED);
 }
 
-/*
- * Get a type.
+/**
+ * qc_get_type - Get a type.
+ *
+ * The program counter is before the start of the `type'. For a struct
+ * type, which is `struct' followed by its tag, the current token is the
+ * tag on return; otherwise it is the last keyword of the type.
  *
- * The program counter is before the start of the `type'.
+ * `static' and `const' may come before the type, in either order. For
+ * `const', QC_CONST is set in the type returned; the caller decides what
+ * it applies to (see decl_type()), and clears it before the type goes in
+ * a Variable or an Atom.
  *
  * note: This does not check if pointer
  *
  * return: type, in qctoken_t format, or -1 cast to qctoken_t
  * width if not a valid type declaration.
  */
-static qctoken_t qc_get_type(void)
+qctoken_t qc_get_type(void)
 {
         int uns = 0;
         int st  = 0;
         qctoken_t ret;
 
-        qc_lex();
-        if (QC_ISSTATIC(qc_token)) {
-                st = QC_STATIC;
-                qc_lex();
+        for (qc_lex(); ; qc_lex()) {
+                if (QC_ISSTATIC(qc_token))
+                        st |= QC_STATIC;
+                else if (QC_ISCONST(qc_token))
+                        st |= QC_CONST;
+                else
+                        break;
         }
 
         if (!QC_ISSIGNED(qc_token)) {
@@ -1002,6 +1625,14 @@ static qctoken_t qc_get_type(void)
                         ret = QC_UINT | st | QC_TYPE;
                 else
                         ret = -1;
+        } else if (QC_TOK(qc_token) == QC_STRUCT) {
+                qc_lex();
+                if (QC_TOK(qc_token) != QC_IDENTIFIER)
+                        qcsyntax(QCE_IDENTIFIER_EXPECTED);
+                ret = qc_struct_type(qc_token_string);
+                if (ret == 0)
+                        qcsyntax(QCE_UNK_TYPE);
+                ret |= st;
         } else {
                 ret = QC_TYPEOF(qc_token) | uns | st | QC_TYPE;
         }
@@ -1017,14 +1648,16 @@ static qctoken_t qc_get_type(void)
 void qc_decl_local(void)
 {
         Variable v;
-        qctoken_t type;
-        int size, idx;
+        Variable *p;
+        char name[ID_LEN + 1];
+        const char *site;
+        qctoken_t type, vtype;
+        size_t dims[QC_ARRAY_MAXDIM];
+        size_t size, row;
 
         type = qc_get_type();
         if (type == -1)
                 qcsyntax(QCE_TYPE_EXPECTED);
-        v.v_type = type;
-        v.v_array = NULL; /* always, for local vars */
 
         /* No wasting time initializing the variable; require
          * the user to do that, like in ordinary C */
@@ -1032,58 +1665,61 @@ void qc_decl_local(void)
         do {
                 /* process comma-separated list */
                 v.v_flag = 0;
+                v.v_ndim = 0;
+                v.v_value.ulli = 0ULL;
                 qc_lex();
-                if (QC_TOK(qc_token) == QC_MULTOK) {
-                        v.v_type |= QC_PTR;
-                        qc_lex();
-                } else {
-                        v.v_type &= ~QC_PTR;
-                }
+                vtype = decl_type(type);
+                v.v_type = vtype & ~QC_CONST;
 
                 if (QC_TOK(qc_token) != QC_IDENTIFIER)
                         qcsyntax(QCE_IDENTIFIER_EXPECTED);
 
-                strcpy(v.v_name, qc_token_string);
+                strcpy(name, qc_token_string);
+                site = qc_program_counter_save;
                 qc_lex();
 
+                if (QC_ISSTATIC(type)) {
+                        local_static(name, site, vtype);
+                        continue;
+                }
+
                 if (QC_TOK(qc_token) == QC_OPENSQU) {
                         v.v_flag |= QC_VFLAG_ARRAY;
 
-                        qc_lex();
-                        if (QC_TOK(qc_token) != QC_NUMBER)
-                                qcsyntax(QCE_ARRAYSIZE_NOT_LIT);
-
-                        size = strtoul(qc_token_string, NULL, 0);
-                        if (size > QC_LARRAY_MAX)
-                                qcsyntax(QCE_ARRAY_TOO_BIG);
-
-                        qc_lex();
-                        if (QC_TOK(qc_token) != QC_CLOSESQU)
-                                qcsyntax(QCE_SQUBRACE_EXPECTED);
-                        qc_lex();
+                        size = decl_array_dims(&v, dims, &row,
+                                               QC_LARRAY_MAX);
+                        if (QC_TOK(qc_token) == QC_EQEQ) {
+                                local_array_init(&v, size, dims, row,
+                                                 QC_ISCONST(vtype));
+                                size = v.v_asize;
+                        } else if (size == 0) {
+                                qcsyntax(QCE_ARRAY_INITIALIZER);
+                        } else {
+                                array_alloc(&v, size, dims, NULL);
+                        }
+                } else if (QC_ISSTRUCT(v.v_type)) {
+                        /* Its members are stored like array elements */
+                        v.v_array = local_alloc(qc_type_size(v.v_type));
+                        size = 1;
                 } else {
+                        v.v_array = NULL;
                         size = 1;
                 }
 
                 v.v_asize = size;
-                idx = 0;
-                while (size > 0) {
-                        v.v_aidx = idx;
-                        local_push(&v);
-                        --size;
-                        ++idx;
-                }
+                p = local_push(name, &v);
 
                 /* Maybe initialization. If other vars are used,
                  * they must be declared already. */
                 if (QC_TOK(qc_token) == QC_EQEQ) {
                         Atom a;
-                        if (QC_ISARRAY(&v))
-                                qcsyntax(QCE_ARRAY_INITIALIZER);
+
                         qcexpression(&a);
-                        assign_var(v.v_name, &a);
+                        assign_var_deref(p, &a);
                         qc_lex();
                 }
+                if (QC_ISCONST(vtype))
+                        p->v_flag |= QC_VFLAG_CONST;
 
         } while (QC_TOK(qc_token) == QC_COMMA);
 
@@ -1098,71 +1734,151 @@ void qc_decl_local(void)
  * it only applies to arguments. There is no corresponding pop
  * operation, because the stack is simply reset when returning from
  * a function. See comments to qc_ufunc_pop and qc_ufunc_push.
+ *
+ * Return: Pointer to the pushed variable
  */
-static void local_push(Variable *v)
+static Variable *local_push(const char *name, Variable *v)
 {
-        if (qc_lvar_tos > NUM_LOCAL_VARS)
-                qcsyntax(QCE_TOO_MANY_LVARS);
+        Variable *p;
+
         /* TODO: Args should be checked for initialization */
-        memcpy(&qc_lvar_stack[qc_lvar_tos], v, sizeof(Variable));
+        p = local_slot(name);
+        memcpy(p, v, sizeof(Variable));
+        return p;
+}
+
+/*
+ * Get the next slot of the local variable stack, named `name', for the
+ * caller to fill in.
+ */
+static Variable *local_slot(const char *name)
+{
+        if (qc_lvar_tos >= qc_lvar_max)
+                qcsyntax(QCE_TOO_MANY_LVARS);
+        if (qc_lvar_tos == qc_lvar_nseg * QC_LVAR_SEGSIZE)
+                local_grow();
+        strcpy(qc_lvar_name(qc_lvar_tos), name);
+        return qc_lvar_at(qc_lvar_tos++);
+}
+/* Add a segment to the top of the local variable stack */
+static void local_grow(void)
+{
+        struct qc_lvar_seg_t **segs;
+        struct qc_lvar_seg_t *seg;
+
+        segs = realloc(qc_lvar_seg, (qc_lvar_nseg + 1) * sizeof(*segs));
+        if (segs == NULL)
+                qcsyntax(QCE_NOMEM);
+        qc_lvar_seg = segs;
+
+        seg = malloc(sizeof(*seg));
+        if (seg == NULL)
+                qcsyntax(QCE_NOMEM);
+        qc_lvar_seg[qc_lvar_nseg++] = seg;
+}
 
-        qc_lvar_tos++;
+/*
+ * Get `size' bytes of zeroed storage for a local array's elements. Like
+ * local_push(), there is no corresponding free, because the data stack
+ * and heap list are reset when returning from a function.
+ */
+static void *local_alloc(size_t size)
+{
+        struct qc_lheap_t *lh;
+        size_t n;
+        void *p;
+
+        n = (size + sizeof(*qc_ldata_stack) - 1) / sizeof(*qc_ldata_stack);
+        if (size > QC_LARRAY_HEAP
+            || n > QC_LDATA_SIZE / sizeof(*qc_ldata_stack) - qc_ldata_tos) {
+                /* Too big for the data stack, or it is full. calloc()
+                 * gets big blocks straight from the system, already
+                 * zeroed, rather than clearing them here. */
+                lh = calloc(1, sizeof(*lh) + size);
+                if (lh == NULL)
+                        qcsyntax(QCE_NOMEM);
+                lh->lh_next = qc_lheap;
+                qc_lheap = lh;
+                return lh->lh_data;
+        }
+
+        p = &qc_ldata_stack[qc_ldata_tos];
+        qc_ldata_tos += n;
+        memset(p, 0, size);
+        return p;
+}
+
+/* Free the local arrays on the heap list, back to `to' */
+static void local_heap_unwind(struct qc_lheap_t *to)
+{
+        struct qc_lheap_t *lh;
+
+        while (qc_lheap != to) {
+                lh = qc_lheap;
+                qc_lheap = lh->lh_next;
+                free(lh);
+        }
 }
 
 /*
  * Helpers for qc_uvar_lookup below
  */
-static Variable *qc_local_uvar_lookup(const char *s)
+Variable *qc_local_uvar_lookup(const char *s)
 {
-        register Variable *p, *top, *bottom;
+        Variable *p;
+        int i, bottom;
 
-        top = qc_lvar_stack_top();
         bottom = qc_lvar_stack_bottom();
 
         /* sequential search. User shouldn't have so many
          * local variables anyway. */
-        for (p = top; p >= bottom; --p) {
-                if (!strcmp(p->v_name, s)) {
-                        while (p->v_aidx != 0)
-                                --p;
+        for (i = qc_lvar_tos - 1; i >= bottom; --i) {
+                if (!strcmp(qc_lvar_name(i), s)) {
+                        p = qc_lvar_at(i);
+                        /* `static', see local_static() */
+                        if (p->v_flag & QC_VFLAG_STATIC)
+                                p = p->v_array;
                         return p;
                 }
         }
         return NULL;
 }
 
-static Variable *qc_global_uvar_lookup1(const char *s, Variable *v, hash_t hash)
+/**
+ * qc_lvar_inframe - Check if a variable is a local variable of the
+ * running function.
+ */
+int qc_lvar_inframe(Variable *v)
 {
-        while (v != NULL) {
-                if (v->v_hash == hash) {
-                        if (!strcmp(v->v_name, s))
-                                return v;
+        Variable *seg;
+        int bottom, i, s;
+
+        bottom = qc_lvar_stack_bottom();
+        for (s = bottom / QC_LVAR_SEGSIZE;
+             s * QC_LVAR_SEGSIZE < qc_lvar_tos; ++s) {
+                seg = qc_lvar_seg[s]->ls_var;
+                if (v >= seg && v < &seg[QC_LVAR_SEGSIZE]) {
+                        i = s * QC_LVAR_SEGSIZE + (v - seg);
+                        return i >= bottom && i < qc_lvar_tos;
                 }
-                v = v->v_next;
         }
-        return v;
+        return 0;
 }
 
 static Variable *qc_global_uvar_lookup(const char *s)
 {
         hash_t hash;
-        int hidx;
         Variable *v;
 
         hash = qc_symbol_hash(s);
 
         /* First check the static variables, since we know
          * without any ambiguity that they are file-scope. */
-        hidx = hash % NUM_STATIC_VARS;
-        v = &qc_namespace->var_hashtbl[hidx];
-        v = qc_global_uvar_lookup1(s, v, hash);
+        v = qc_symtab_lookup(&qc_namespace->var_tab, s, hash);
         if (v != NULL)
                 return v;
 
-        hidx = hash % NUM_GLOBAL_VARS;
-        v = &qc_gvar_hashtbl[hidx];
-        v = qc_global_uvar_lookup1(s, v, hash);
-        return v;
+        return qc_symtab_lookup(&qc_gvar_tab, s, hash);
 }
 
 /**
@@ -1201,6 +1917,8 @@ void assign_var(const char *s, Atom *v)
         p = qc_uvar_lookup(s);
         if (p == NULL)
                 qcsyntax(QCE_NOT_VAR);
+        if (QC_ISRDONLY(p))
+                qcsyntax(QCE_CONST_ASSIGN);
 
         qc_mov(&p->v_datum, v);
         p->v_flag |= QC_VFLAG_INITIALIZED;
@@ -1208,46 +1926,63 @@ void assign_var(const char *s, Atom *v)
 
 /**
  * assign_var_deref - Assign a variable if you know the pointer already.
- * @p:  Pointer to the variable to assign. Although it seems like a
- *      friendlier interface to pass the pointer variable instead of the
- *      target variable, this is not always possible, because the pointer
- *      may be an evaluated value, rather than a direct variable. For
- *      example we could get `*(p+1)=x' rather than `p=p+1;*p=x'.
- *
- * This is for assigning values to variables whose addresses have been
- * evaluated by the parser.
+ * @p:  Pointer to the variable to assign.
  *
- * For so many reasons, this is only possible for pointers to
- * user-defined variables. Internal variables (FILE pointers, etc.,
- * must be accessed via internal function calls
+ * This is for assigning values to variables that have already been
+ * looked up by the parser. Array elements and the targets of pointers
+ * are not Variables; they are assigned with qc_store(). Neither are the
+ * members of a struct, which is copied into its storage the same way.
  */
 void assign_var_deref(Variable *p, Atom *v)
 {
         if (qc_uvar_bound_check(p))
                 qcsyntax(QCE_BOUND_ERR);
+        if (QC_ISRDONLY(p))
+                qcsyntax(QCE_CONST_ASSIGN);
+
+        if (QC_ISSTRUCT(p->v_type)) {
+                qc_store(p->v_array, p->v_type, v);
+                p->v_flag |= QC_VFLAG_INITIALIZED;
+                return;
+        }
 
         qc_mov(&p->v_datum, v);
         p->v_flag |= QC_VFLAG_INITIALIZED;
 }
 
 
+/**
+ * qc_va_start - Set up `args' to walk the `n' variable arguments of an
+ * internal function call, starting at `first'.
+ */
+void qc_va_start(qc_va_list args, Atom *first, int n)
+{
+        args->va_next = first;
+        args->va_end  = first + n;
+}
+
+/* Next argument for the qc_va_arg() macro */
+static Atom *va_next(qc_va_list args)
+{
+        if (args->va_next >= args->va_end)
+                qcsyntax(QCE_ARG_EXPECTED);
+        return args->va_next++;
+}
+
 /*
  * Redirection of the qc_va_arg() macro
  */
 int qc_va_iarg_int(qc_va_list args)
 {
-        Atom *a = iarg_pop();
-        return a->a_value.i;
+        return va_next(args)->a_value.i;
 }
 
 long qc_va_iarg_long(qc_va_list args)
 {
-        Atom *a = iarg_pop();
-        return a->a_value.li;
+        return va_next(args)->a_value.li;
 }
 
 long long qc_va_iarg_longlong(qc_va_list args)
 {
-        Atom *a = iarg_pop();
-        return a->a_value.lli;
+        return va_next(args)->a_value.lli;
 }
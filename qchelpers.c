@@ -1,6 +1,7 @@
 #include "qc.h"
 #include "qc_private.h"
 #include <string.h>
+#include <stdlib.h>
 
 /*
  * Functions for saving/restoring user program state. These heavier-duty
@@ -10,7 +11,9 @@
 
 void qc_program_save(struct qc_program_t *penv)
 {
-        strcpy(penv->pb_tksbuf, qc_token_string);
+        /* A string literal token needs no copy; it never changes. */
+        if (qc_token_string == qc_token_string_buffer)
+                strcpy(penv->pb_tksbuf, qc_token_string);
         penv->pb_tok  = qc_token;
         penv->pb_tks  = qc_token_string;
         penv->pb_pc   = qc_program_counter;
@@ -19,9 +22,10 @@ void qc_program_save(struct qc_program_t *penv)
 
 void qc_program_restore(struct qc_program_t *penv)
 {
-        strcpy(qc_token_string, penv->pb_tksbuf);
         qc_token                = penv->pb_tok;
         qc_token_string         = penv->pb_tks;
+        if (qc_token_string == qc_token_string_buffer)
+                strcpy(qc_token_string_buffer, penv->pb_tksbuf);
         qc_program_counter      = penv->pb_pc;
         qc_program_counter_save = penv->pb_pcsv;
 };
@@ -56,3 +60,213 @@ hash_t qc_symbol_hash2delim(const char *s)
         }
         return ret;
 }
+
+/*
+ * Symbol tables
+ */
+
+/* First slot to look in for `hash' */
+static inline size_t qc_symtab_home(const struct qc_symtab_t *st, hash_t hash)
+{
+        size_t h = (size_t)hash;
+
+        /* Fold the high bits in, since only the low ones are used */
+        h ^= h >> 16;
+        return h & st->st_mask;
+}
+
+/**
+ * qc_symtab_lookup - Find a symbol in a hash table
+ * @st: The table
+ * @name: Symbol name
+ * @hash: qc_symbol_hash() of @name
+ *
+ * Return: The symbol that was passed to qc_symtab_insert(), or NULL if
+ * @name is not in the table.
+ */
+void *qc_symtab_lookup(const struct qc_symtab_t *st,
+                       const char *name, hash_t hash)
+{
+        const struct qc_symslot_t *slot;
+        size_t i;
+
+        if (st->st_slot == NULL)
+                return NULL;
+
+        for (i = qc_symtab_home(st, hash); ; i = (i + 1) & st->st_mask) {
+                slot = &st->st_slot[i];
+                if (slot->s_name == NULL)
+                        return NULL;
+                if (slot->s_hash == hash && !strcmp(slot->s_name, name))
+                        return slot->s_sym;
+        }
+}
+
+/* Resize the slots of `st' to `size', which is a power of two */
+static int qc_symtab_resize(struct qc_symtab_t *st, size_t size)
+{
+        struct qc_symslot_t *old = st->st_slot;
+        size_t oldsize = old != NULL ? st->st_mask + 1 : 0;
+        size_t i, j;
+
+        st->st_slot = calloc(size, sizeof(*st->st_slot));
+        if (st->st_slot == NULL) {
+                st->st_slot = old;
+                return -QCE_NOMEM;
+        }
+        st->st_mask = size - 1;
+
+        for (i = 0; i < oldsize; ++i) {
+                if (old[i].s_name == NULL)
+                        continue;
+                j = qc_symtab_home(st, old[i].s_hash);
+                while (st->st_slot[j].s_name != NULL)
+                        j = (j + 1) & st->st_mask;
+                st->st_slot[j] = old[i];
+        }
+        free(old);
+        return 0;
+}
+
+/**
+ * qc_symtab_insert - Insert a symbol into a hash table
+ * @st: The table
+ * @name: Symbol name. This must stay valid as long as the table does.
+ * @hash: qc_symbol_hash() of @name
+ * @sym: The symbol
+ *
+ * If a symbol named @name is in the table already, @sym replaces it.
+ *
+ * Return: Zero, or -QCE_NOMEM if the table could not grow.
+ */
+int qc_symtab_insert(struct qc_symtab_t *st, const char *name,
+                     hash_t hash, void *sym)
+{
+        struct qc_symslot_t *slot;
+        size_t i;
+        int ret;
+
+        if (st->st_slot == NULL) {
+                ret = qc_symtab_resize(st, QC_SYMTAB_INIT);
+                if (ret)
+                        return ret;
+        } else if ((st->st_count + 1) * 100
+                   > (st->st_mask + 1) * QC_SYMTAB_LOAD) {
+                ret = qc_symtab_resize(st, (st->st_mask + 1) * 2);
+                if (ret)
+                        return ret;
+        }
+
+        for (i = qc_symtab_home(st, hash); ; i = (i + 1) & st->st_mask) {
+                slot = &st->st_slot[i];
+                if (slot->s_name == NULL) {
+                        ++st->st_count;
+                        break;
+                }
+                if (slot->s_hash == hash && !strcmp(slot->s_name, name))
+                        break;
+        }
+        slot->s_hash = hash;
+        slot->s_name = name;
+        slot->s_sym = sym;
+        return 0;
+}
+
+/**
+ * qc_symtab_free - Empty a hash table and free its slots. The symbols
+ * in it are not freed.
+ */
+void qc_symtab_free(struct qc_symtab_t *st)
+{
+        free(st->st_slot);
+        st->st_slot = NULL;
+        st->st_mask = 0;
+        st->st_count = 0;
+}
+
+/*
+ * Arenas
+ */
+
+/* Header of each block of memory that an arena allocates from */
+struct qc_arena_chunk_t {
+        struct qc_arena_chunk_t *ac_next;
+        long long ac_data[];
+};
+
+/**
+ * qc_arena_alloc - Allocate from an arena
+ * @a: The arena
+ * @size: Number of bytes
+ *
+ * There is no corresponding free; the memory lasts until the whole arena
+ * is freed with qc_arena_free().
+ *
+ * Return: Zeroed memory, aligned for any QC type, or NULL if out of
+ * memory.
+ */
+void *qc_arena_alloc(struct qc_arena_t *a, size_t size)
+{
+        struct qc_arena_chunk_t *c;
+        void *p;
+
+        size = (size + sizeof(long long) - 1) & ~(sizeof(long long) - 1);
+        if (size > (size_t)(a->a_end - a->a_next)) {
+                if (size > QC_ARENA_CHUNK / 4) {
+                        /* Big ones get a chunk of their own, so that
+                         * the rest of the current one is not wasted.
+                         * calloc() gets those straight from the
+                         * system, already zeroed. */
+                        c = calloc(1, sizeof(*c) + size);
+                        if (c == NULL)
+                                return NULL;
+                        c->ac_next = a->a_chunk;
+                        a->a_chunk = c;
+                        return c->ac_data;
+                }
+                c = calloc(1, sizeof(*c) + QC_ARENA_CHUNK);
+                if (c == NULL)
+                        return NULL;
+                c->ac_next = a->a_chunk;
+                a->a_chunk = c;
+                a->a_next = (char *)c->ac_data;
+                a->a_end = a->a_next + QC_ARENA_CHUNK;
+        }
+        p = a->a_next;
+        a->a_next += size;
+        return p;
+}
+
+/**
+ * qc_arena_strdup - Like strdup(), but allocate from arena `a'
+ */
+char *qc_arena_strdup(struct qc_arena_t *a, const char *s)
+{
+        char *ret;
+        size_t n = strlen(s) + 1;
+
+        ret = qc_arena_alloc(a, n);
+        if (ret != NULL)
+                memcpy(ret, s, n);
+        return ret;
+}
+
+/**
+ * qc_arena_free - Free everything allocated from an arena. This leaves
+ * the arena empty, ready to be used again.
+ *
+ * Note: If the arena's struct was itself allocated from the arena, copy
+ * it out first.
+ */
+void qc_arena_free(struct qc_arena_t *a)
+{
+        struct qc_arena_chunk_t *c;
+
+        while (a->a_chunk != NULL) {
+                c = a->a_chunk;
+                a->a_chunk = c->ac_next;
+                free(c);
+        }
+        a->a_next = NULL;
+        a->a_end = NULL;
+}
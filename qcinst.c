@@ -17,6 +17,106 @@ static void qc_swap_data(Atom *left, Atom *right)
         memcpy(right, &tmp, sizeof(Atom));
 }
 
+/**
+ * qc_type_size - Get the number of bytes a datum of a type takes up in
+ *              an array, or where a pointer points to it.
+ * @type: the type, as a Variable's v_type
+ */
+size_t qc_type_size(qctoken_t type)
+{
+        if (QC_ISPTR(type))
+                return sizeof(void *);
+        if (QC_ISSTRUCT(type))
+                return qc_struct_of(type)->st_size;
+        switch (QC_TOK(type)) {
+        case QC_CHAR:
+                return sizeof(char);
+        case QC_INT:
+                return sizeof(int);
+        case QC_FLT:
+                return sizeof(float);
+        case QC_DBL:
+                return sizeof(double);
+        default:
+                /* FILE handles, which are pointers anyway */
+                return sizeof(void *);
+        }
+}
+
+/**
+ * qc_type_align - Get the alignment of a datum of a type, as the C
+ *              compiler would align it in a struct.
+ * @type: the type, as a Variable's v_type
+ */
+size_t qc_type_align(qctoken_t type)
+{
+        if (QC_ISSTRUCT(type))
+                return qc_struct_of(type)->st_align;
+        /* Every other type is its own size */
+        return qc_type_size(type);
+}
+
+/**
+ * qc_ptr_stride - Get the number of bytes between two consecutive
+ *              elements pointed at by a pointer.
+ * @type: the pointer's type
+ *
+ * Anything that walks a pointer or array without qc_ptr_add() must
+ * step by this amount, so that it agrees with qc_ptr_add().
+ */
+long qc_ptr_stride(qctoken_t type)
+{
+        type &= ~QC_PTR;
+        if (QC_ISVOID(type))
+                return 1;
+        return qc_type_size(type);
+}
+
+/**
+ * qc_load - Get a datum from where a pointer or an array points.
+ * @a: Atom to store the datum
+ * @addr: the datum's address
+ * @type: the datum's type
+ *
+ * Every member of an Atom's a_value starts at its first byte, so the
+ * datum is copied there as-is. A struct does not fit in an Atom, so it
+ * is not copied; the Atom gets its address instead, for qc_store() to
+ * copy it from.
+ */
+void qc_load(Atom *a, const void *addr, qctoken_t type)
+{
+        a->a_type = type;
+        if (QC_ISSTRUCT(type)) {
+                a->a_value.p = (void *)addr;
+                return;
+        }
+        a->a_value.ulli = 0ULL;
+        memcpy(&a->a_value, addr, qc_type_size(type));
+}
+
+/**
+ * qc_store - Put a datum where a pointer or an array points.
+ * @addr: the datum's address
+ * @type: the datum's type
+ * @v: value to store, which will be cast to @type first
+ */
+void qc_store(void *addr, qctoken_t type, Atom *v)
+{
+        Atom tmp;
+
+        if (QC_ISSTRUCT(type)) {
+                if (QC_TYPEOF(v->a_type) != QC_TYPEOF(type))
+                        qcsyntax(QCE_TYPE_MISMATCH);
+                /* The source may overlap, eg `a[i] = a[j]' with i == j */
+                memmove(addr, v->a_value.p, qc_type_size(type));
+                return;
+        }
+
+        tmp.a_type = type;
+        qc_mov(&tmp, v);
+        memcpy(addr, &tmp.a_value, qc_type_size(type));
+}
+
 /**
  * qc_ptr_add - Perform addition between two data, in which the
  *              operand is a pointer.
@@ -26,7 +126,7 @@ static void qc_swap_data(Atom *left, Atom *right)
  */
 static void qc_ptr_add(Atom *left, Atom *right)
 {
-        long int size = sizeof(Variable);
+        long int size = qc_ptr_stride(left->a_type);
 
         switch (QC_TYPEOF(right->a_type)) {
         case QC_CHAR:
@@ -40,10 +140,25 @@ static void qc_ptr_add(Atom *left, Atom *right)
         }
 }
 
+/*
+ * Subtract pointer `right' from pointer `left', of the same type. The
+ * result is the number of elements between them, as an `int'.
+ */
+static void qc_ptr_diff(Atom *left, Atom *right)
+{
+        long int size = qc_ptr_stride(left->a_type);
+        long int d;
+
+        d = ((char *)left->a_value.p - (char *)right->a_value.p) / size;
+        left->a_type = QC_INT;
+        left->a_value.ulli = 0ULL;
+        left->a_value.i = (int)d;
+}
+
 /* Like qc_ptr_addition, but subtraction instead. */
 static void qc_ptr_sub(Atom *left, Atom *right)
 {
-        long int size = sizeof(Variable);
+        long int size = qc_ptr_stride(left->a_type);
 
         switch (QC_TYPEOF(right->a_type)) {
         case QC_CHAR:
@@ -337,7 +452,7 @@ static void qc_int_asr(Atom *v, Atom *amt)
 
 static int qc_int_cmp(Atom *left, Atom *right, int op)
 {
-        unsigned long long lval, rval;
+        long long lval, rval;
         int result;
 
         lval = qc_get_int_operand(left);
@@ -478,10 +593,20 @@ static void qc_int_mov(Atom *to, Atom *from)
 }
 
 
+/* A struct Atom refers to its struct, see qc_load() */
+static void qc_struct_mov(Atom *to, Atom *from)
+{
+        if (QC_TYPEOF(from->a_type) != QC_TYPEOF(to->a_type))
+                qcsyntax(QCE_TYPE_MISMATCH);
+        to->a_value.p = from->a_value.p;
+}
+
 void qc_mov(Atom *to, Atom *from)
 {
         if (QC_ISPTR((to)->a_type))
                 qc_ptr_mov(to, from);
+        else if (QC_ISSTRUCT(to->a_type))
+                qc_struct_mov(to, from);
         else if (QC_ISFLT((to)->a_type))
                 qc_fmov(to, from);
         else
@@ -528,7 +653,11 @@ void qc_sub(Atom *to, Atom *from)
         if (QC_ISPTR(from->a_type)) {
                 /* Cannot subtract a pointer from
                  * an integer type. */
-                qcsyntax(QCE_TYPE_INVAL);
+                if (!QC_ISPTR(to->a_type))
+                        qcsyntax(QCE_TYPE_INVAL);
+                if (QC_TYPEOF(to->a_type) != QC_TYPEOF(from->a_type))
+                        qcsyntax(QCE_TYPE_MISMATCH);
+                qc_ptr_diff(to, from);
         } else if (QC_ISPTR(to->a_type)) {
                 qc_ptr_sub(to, from);
         } else if (QC_ISFLT((to)->a_type)) {
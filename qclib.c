@@ -3,8 +3,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "qc.h"
+#include "qc_private.h"
 
 FILE *fplist[QC_NFILES];
 
@@ -58,19 +61,14 @@ static void qcputc(int c, struct printf_reent_t *r)
  * WARNING: If the namespace (IE QC file) calling this function
  * exits early due to an error, the file will remain open.
  */
-void qccall_fopen(Atom *ret)
+void qccall_fopen(Atom *args, int nargs, Atom *ret)
 {
         FILE *fp;
-        Atom *params[2];
 
         if (!QC_ISPTR(ret->a_type))
                 qcsyntax(QCE_SYNTAX);
 
-        params[0] = iarg_pop();
-        params[1] = iarg_pop();
-
-        fp = fopen((char *)params[0]->a_value.p,
-                    (char *)params[1]->a_value.p);
+        fp = fopen((char *)args[0].a_value.p, (char *)args[1].a_value.p);
         if (fp != NULL) {
                 if (qcaddfp(fp)) {
                         fclose(fp);
@@ -81,83 +79,74 @@ void qccall_fopen(Atom *ret)
 }
 
 /* Equivalent to fclose in most cases */
-void qccall_fclose(Atom *ret)
+void qccall_fclose(Atom *args, int nargs, Atom *ret)
 {
-        Atom *value;
         FILE *fp;
 
-        value = iarg_pop();
-        if (!QC_ISPTR(value->a_type))
+        if (!QC_ISPTR(args[0].a_type))
                 qcsyntax(QCE_SYNTAX);
 
-        fp = (FILE *)value->a_value.p;
+        fp = (FILE *)args[0].a_value.p;
 
         ret->a_value.i = qcremovefp(fp);
 }
 
 /* Equivalent to fputs in most cases */
-void qccall_fputs(Atom *ret)
+void qccall_fputs(Atom *args, int nargs, Atom *ret)
 {
-        Atom *params[2];
         FILE *fp;
         char *s;
 
-        params[0] = iarg_pop();
-        params[1] = iarg_pop();
-
-        if (!QC_ISPTR(params[0]->a_type))
+        if (!QC_ISPTR(args[0].a_type))
                 qcsyntax(QCE_SYNTAX);
 
-        if (!QC_ISPTR(params[1]->a_type))
+        if (!QC_ISPTR(args[1].a_type))
                 qcsyntax(QCE_SYNTAX);
 
-        s = (char *)params[0]->a_value.p;
-        fp = (FILE *)params[1]->a_value.p;
+        s = (char *)args[0].a_value.p;
+        fp = (FILE *)args[1].a_value.p;
 
         ret->a_value.i = fputs(s, fp);
 }
 
 /* Equivalent to getchar */
-void qccall_getchar(Atom *ret)
+void qccall_getchar(Atom *args, int nargs, Atom *ret)
 {
         ret->a_value.i = getchar();
 }
 
 /* Similar to printf, buf with limitations. Floating point and the
 %p conversion are not supported */
-void qccall_printf(Atom *ret)
+void qccall_printf(Atom *args, int nargs, Atom *ret)
 {
-        Atom *fmtparam;
         char *fmt;
-        qc_va_list args = NULL; /* This will change when we mean it */
+        struct qc_va_t ap;
         struct printf_reent_t pcall;
 
-        fmtparam = iarg_pop();
-        if (!QC_ISPTR(fmtparam->a_type))
+        if (!QC_ISPTR(args[0].a_type))
                 qcsyntax(QCE_SYNTAX);
 
-        fmt = (char *)fmtparam->a_value.p;
+        fmt = (char *)args[0].a_value.p;
+        qc_va_start(&ap, &args[1], nargs - 1);
 
         pcall.fn         = qcputc;
         pcall.out.stream = stdout;
         pcall.count      = 0;
         pcall.limit      = -1; /* Needed if we make qcputc check this */
 
-        qcprint_r(fmt, args, &pcall);
+        qcprint_r(fmt, &ap, &pcall);
         ret->a_value.i = pcall.count;
 }
 
 /* Equivalent to puts */
-void qccall_puts(Atom *ret)
+void qccall_puts(Atom *args, int nargs, Atom *ret)
 {
-        Atom *params[1];
         char *s;
 
-        params[0] = iarg_pop();
-        if (!QC_ISPTR(params[0]->a_type))
+        if (!QC_ISPTR(args[0].a_type))
                 qcsyntax(QCE_SYNTAX);
 
-        s = (char *)params[0]->a_value.p;
+        s = (char *)args[0].a_value.p;
         puts(s);
         ret->a_value.i = 0;
 }
@@ -171,14 +160,623 @@ void qccall_puts(Atom *ret)
  * cleanup. If any files were opened by the namespace, they will still be
  * open.
  */
-void qccall_exit(Atom *ret)
+void qccall_exit(Atom *args, int nargs, Atom *ret)
+{
+        ret->a_value.i = args[0].a_value.i;
+
+        qc_exit(args[0].a_value.i);
+}
+
+/*
+ *                      malloc() and friends
+ *
+ * Each block has a struct qc_mblk_t header in front of it. Small blocks
+ * come from their Namespace's arena, so they go away with it; when
+ * free'd, they are put on the free list of their size class for the
+ * next malloc() of that class. Big blocks are malloc'd with a struct
+ * qc_mbig_t in front of the header, which keeps them on a list so they
+ * can be freed if the program forgets to.
+ *
+ * A pointer passed to free() or realloc() may be anything the program
+ * has, so it is looked up in the heaps' tables of allocated blocks
+ * before the header in front of it is read.
+ */
+
+/*
+ * struct qc_mblk_t - Header of a block from the malloc() builtin
+ * @mb_ns: Namespace whose heap the block belongs to
+ * @mb_size: Size asked for
+ * @mb_class: Size class, or QC_HEAP_NCLASS for a big block
+ * @mb_data: The block. While it is free, this holds the pointer to the
+ *      next free block of its size class; see mblk_next().
+ */
+struct qc_mblk_t {
+        Namespace *mb_ns;
+        size_t mb_size;
+        unsigned int mb_class;
+        long long mb_data[];
+};
+
+struct qc_mbig_t {
+        struct qc_mbig_t *bg_next;
+        struct qc_mbig_t *bg_prev;
+        struct qc_mblk_t bg_blk;
+};
+
+/* Next free block after free block `b' */
+static inline struct qc_mblk_t *mblk_next(const struct qc_mblk_t *b)
 {
-        Atom *param;
+        struct qc_mblk_t *next;
 
-        param = iarg_pop();
-        ret->a_value.i = param->a_value.i;
+        memcpy(&next, b->mb_data, sizeof(next));
+        return next;
+}
+
+static inline void mblk_set_next(struct qc_mblk_t *b, struct qc_mblk_t *next)
+{
+        memcpy(b->mb_data, &next, sizeof(next));
+}
+
+/* Slot in a table of 2^`bits' entries to start looking for `p' */
+static inline size_t live_home(const void *p, int bits)
+{
+        return (size_t)(((unsigned long long)(uintptr_t)p
+                         * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+/*
+ * Slot of block `p' in the table of live blocks of heap `h', or of the
+ * empty slot where it would go
+ */
+static size_t live_find(const struct qc_heap_t *h, const void *p)
+{
+        size_t i, mask = ((size_t)1 << h->h_live_bits) - 1;
 
-        qc_exit(param->a_value.i);
+        for (i = live_home(p, h->h_live_bits); h->h_live[i] != NULL;
+             i = (i + 1) & mask) {
+                if (h->h_live[i]->mb_data == p)
+                        break;
+        }
+        return i;
+}
+
+/*
+ * Enter block `b' in the table of live blocks of heap `h'. The table is
+ * doubled once it is half full.
+ *
+ * Return: Zero, or -QCE_NOMEM
+ */
+static int live_insert(struct qc_heap_t *h, struct qc_mblk_t *b)
+{
+        struct qc_mblk_t **old = h->h_live;
+        size_t i, n;
+
+        n = old == NULL ? 0 : (size_t)1 << h->h_live_bits;
+        if (h->h_nlive + 1 > n / 2) {
+                h->h_live = calloc(n == 0 ? 64 : n * 2, sizeof(*old));
+                if (h->h_live == NULL) {
+                        h->h_live = old;
+                        return -QCE_NOMEM;
+                }
+                h->h_live_bits = n == 0 ? 6 : h->h_live_bits + 1;
+                for (i = 0; i < n; ++i) {
+                        if (old[i] != NULL)
+                                h->h_live[live_find(h, old[i]->mb_data)]
+                                        = old[i];
+                }
+                free(old);
+        }
+        h->h_live[live_find(h, b->mb_data)] = b;
+        ++h->h_nlive;
+        return 0;
+}
+
+/*
+ * Take the block in slot `i' out of the table of live blocks of heap
+ * `h'. The blocks after it in its run are moved back, if that brings
+ * them closer to their home slots, so that no lookup stops short of
+ * them.
+ */
+static void live_remove(struct qc_heap_t *h, size_t i)
+{
+        size_t j, k, mask = ((size_t)1 << h->h_live_bits) - 1;
+
+        for (j = (i + 1) & mask; h->h_live[j] != NULL; j = (j + 1) & mask) {
+                k = live_home(h->h_live[j]->mb_data, h->h_live_bits);
+                /* Leave it if its home is cyclically in (i, j] */
+                if (i < j ? (k > i && k <= j) : (k > i || k <= j))
+                        continue;
+                h->h_live[i] = h->h_live[j];
+                i = j;
+        }
+        h->h_live[i] = NULL;
+        --h->h_nlive;
+}
+
+/* Size class for `size' bytes, or QC_HEAP_NCLASS if too big for one */
+static unsigned int heap_class(size_t size)
+{
+        unsigned int c = 0;
+
+        while (c < QC_HEAP_NCLASS && size > (size_t)QC_HEAP_MINBLK << c)
+                ++c;
+        return c;
+}
+
+/* Get a small block of size class `c' from heap `h' */
+static struct qc_mblk_t *heap_get(Namespace *ns, unsigned int c)
+{
+        struct qc_heap_t *h = &ns->heap;
+        struct qc_mblk_t *b;
+        size_t bsize, n;
+        char *slab;
+
+        if (h->h_free[c] == NULL) {
+                /* Carve out a new slab into free blocks */
+                bsize = sizeof(*b) + ((size_t)QC_HEAP_MINBLK << c);
+                n = QC_HEAP_SLAB / bsize;
+                if (n == 0)
+                        n = 1;
+                slab = qc_arena_alloc(&ns->arena, n * bsize);
+                if (slab == NULL)
+                        return NULL;
+                h->h_stats.hs_pooled += n * bsize;
+                while (n-- > 0) {
+                        b = (struct qc_mblk_t *)(slab + n * bsize);
+                        b->mb_ns = ns;
+                        b->mb_class = c;
+                        mblk_set_next(b, h->h_free[c]);
+                        h->h_free[c] = b;
+                }
+        }
+        b = h->h_free[c];
+        h->h_free[c] = mblk_next(b);
+        return b;
+}
+
+/*
+ * Allocate `size' bytes in the current namespace's heap.
+ * Return: Pointer to the memory, or NULL if out of memory, or if there
+ * is no namespace for it to belong to (a call from the command
+ * interpreter)
+ */
+static void *heap_alloc(size_t size)
+{
+        Namespace *ns = qc_namespace;
+        struct qc_heap_t *h;
+        struct qc_mbig_t *bg;
+        struct qc_mblk_t *b;
+        unsigned int c;
+
+        if (ns == NULL)
+                return NULL;
+        h = &ns->heap;
+        c = heap_class(size);
+        if (c < QC_HEAP_NCLASS) {
+                b = heap_get(ns, c);
+                if (b == NULL)
+                        return NULL;
+                if (live_insert(h, b)) {
+                        mblk_set_next(b, h->h_free[c]);
+                        h->h_free[c] = b;
+                        return NULL;
+                }
+        } else {
+                if (size > (size_t)-1 - sizeof(*bg))
+                        return NULL;
+                bg = malloc(sizeof(*bg) + size);
+                if (bg == NULL)
+                        return NULL;
+                b = &bg->bg_blk;
+                if (live_insert(h, b)) {
+                        free(bg);
+                        return NULL;
+                }
+                bg->bg_prev = NULL;
+                bg->bg_next = h->h_big;
+                if (h->h_big != NULL)
+                        h->h_big->bg_prev = bg;
+                h->h_big = bg;
+                ++h->h_stats.hs_nbig;
+                b->mb_ns = ns;
+                b->mb_class = c;
+        }
+        b->mb_size = size;
+
+        ++h->h_stats.hs_nalloc;
+        h->h_stats.hs_inuse += size;
+        if (h->h_stats.hs_inuse > h->h_stats.hs_peak)
+                h->h_stats.hs_peak = h->h_stats.hs_inuse;
+        return b->mb_data;
+}
+
+/* Live block `p' of heap `h', or NULL if `p' is not one */
+static struct qc_mblk_t *heap_lookup(const struct qc_heap_t *h, void *p)
+{
+        if (h->h_live == NULL)
+                return NULL;
+        return h->h_live[live_find(h, p)];
+}
+
+/*
+ * Header of block `p', after making sure that it is one. It is most
+ * likely from the running program's own heap, but may be from any.
+ */
+static struct qc_mblk_t *heap_block(void *p)
+{
+        struct qc_mblk_t *b;
+        Namespace *ns;
+
+        if (qc_namespace != NULL) {
+                b = heap_lookup(&qc_namespace->heap, p);
+                if (b != NULL)
+                        return b;
+        }
+        for (ns = qc_namespace_list; ns != NULL; ns = ns->list) {
+                if (ns == qc_namespace)
+                        continue;
+                b = heap_lookup(&ns->heap, p);
+                if (b != NULL)
+                        return b;
+        }
+        qcsyntax(QCE_BAD_FREE);
+        return NULL;
+}
+
+/* Free block `b' back to the heap it came from */
+static void heap_free(struct qc_mblk_t *b)
+{
+        struct qc_heap_t *h = &b->mb_ns->heap;
+        struct qc_mbig_t *bg;
+
+        ++h->h_stats.hs_nfree;
+        h->h_stats.hs_inuse -= b->mb_size;
+        live_remove(h, live_find(h, b->mb_data));
+
+        if (b->mb_class < QC_HEAP_NCLASS) {
+                mblk_set_next(b, h->h_free[b->mb_class]);
+                h->h_free[b->mb_class] = b;
+                return;
+        }
+
+        bg = (struct qc_mbig_t *)((char *)b
+                                  - offsetof(struct qc_mbig_t, bg_blk));
+        if (bg->bg_prev != NULL)
+                bg->bg_prev->bg_next = bg->bg_next;
+        else
+                h->h_big = bg->bg_next;
+        if (bg->bg_next != NULL)
+                bg->bg_next->bg_prev = bg->bg_prev;
+        --h->h_stats.hs_nbig;
+        free(bg);
+}
+
+/*
+ * Size argument to malloc(), memcpy() and friends. An Atom keeps an
+ * integer zero-extended, so its sign comes from its type.
+ */
+static size_t size_arg(Atom *a)
+{
+        long long n;
+
+        if (QC_ISPTR(a->a_type))
+                qcsyntax(QCE_TYPE_INVAL);
+        switch (QC_TOK(a->a_type)) {
+        case QC_CHAR:
+                n = QC_ISSIGNED(a->a_type) ? (long long)a->a_value.c
+                                           : (long long)a->a_value.uc;
+                break;
+        case QC_INT:
+                n = QC_ISSIGNED(a->a_type) ? (long long)a->a_value.i
+                                           : (long long)a->a_value.ui;
+                break;
+        default:
+                n = -1;
+                break;
+        }
+        if (n < 0)
+                qcsyntax(QCE_TYPE_INVAL);
+        return (size_t)n;
+}
+
+/*
+ * Similar to malloc. The memory belongs to the calling program's
+ * namespace, and is freed with it if the program does not free it.
+ */
+void qccall_malloc(Atom *args, int nargs, Atom *ret)
+{
+        size_t size;
+
+        size = size_arg(&args[0]);
+        ret->a_value.p = heap_alloc(size);
+}
+
+/* Similar to calloc */
+void qccall_calloc(Atom *args, int nargs, Atom *ret)
+{
+        size_t n, size;
+        void *p;
+
+        n = size_arg(&args[0]);
+        size = size_arg(&args[1]);
+        if (size != 0 && n > (size_t)-1 / size) {
+                ret->a_value.p = NULL;
+                return;
+        }
+        p = heap_alloc(n * size);
+        if (p != NULL)
+                memset(p, 0, n * size);
+        ret->a_value.p = p;
+}
+
+/* Similar to realloc */
+void qccall_realloc(Atom *args, int nargs, Atom *ret)
+{
+        Atom *param = &args[0];
+        struct qc_mblk_t *b = NULL;
+        size_t size;
+        void *p;
+
+        if (!QC_ISPTR(param->a_type) && param->a_value.p != NULL)
+                qcsyntax(QCE_TYPE_INVAL);
+        size = size_arg(&args[1]);
+        if (param->a_value.p != NULL)
+                b = heap_block(param->a_value.p);
+
+        if (b != NULL && size == 0) {
+                heap_free(b);
+                ret->a_value.p = NULL;
+                return;
+        }
+
+        /* Small enough for the block it is already in */
+        if (b != NULL && b->mb_class < QC_HEAP_NCLASS
+            && heap_class(size) == b->mb_class) {
+                b->mb_ns->heap.h_stats.hs_inuse += size - b->mb_size;
+                b->mb_size = size;
+                ret->a_value.p = b->mb_data;
+                return;
+        }
+
+        p = heap_alloc(size);
+        if (p != NULL && b != NULL) {
+                memcpy(p, b->mb_data, size < b->mb_size ? size : b->mb_size);
+                heap_free(b);
+        }
+        ret->a_value.p = p;
+}
+
+/* Similar to free */
+void qccall_free(Atom *args, int nargs, Atom *ret)
+{
+        Atom *param = &args[0];
+
+        if (!QC_ISPTR(param->a_type) && param->a_value.p != NULL)
+                qcsyntax(QCE_TYPE_INVAL);
+        if (param->a_value.p != NULL)
+                heap_free(heap_block(param->a_value.p));
+        ret->a_value.i = 0;
+}
+
+/*
+ *                      memcpy() and friends
+ *
+ * These move whole buffers, of any type, in one call. Like the pointers
+ * that scripts pass them, they are not checked against the size of what
+ * they point at.
+ */
+
+/* Pointer argument to memcpy() and friends */
+static void *mem_ptr_arg(Atom *a)
+{
+        if (!QC_ISPTR(a->a_type) || a->a_value.p == NULL)
+                qcsyntax(QCE_TYPE_INVAL);
+        return a->a_value.p;
+}
+
+/* Equivalent to memcpy */
+void qccall_memcpy(Atom *args, int nargs, Atom *ret)
+{
+        void *dst, *src;
+        size_t n;
+
+        dst = mem_ptr_arg(&args[0]);
+        src = mem_ptr_arg(&args[1]);
+        n = size_arg(&args[2]);
+        ret->a_value.p = memcpy(dst, src, n);
+}
+
+/* Equivalent to memmove */
+void qccall_memmove(Atom *args, int nargs, Atom *ret)
+{
+        void *dst, *src;
+        size_t n;
+
+        dst = mem_ptr_arg(&args[0]);
+        src = mem_ptr_arg(&args[1]);
+        n = size_arg(&args[2]);
+        ret->a_value.p = memmove(dst, src, n);
+}
+
+/* Equivalent to memset */
+void qccall_memset(Atom *args, int nargs, Atom *ret)
+{
+        void *dst;
+        Atom *c = &args[1];
+        size_t n;
+
+        dst = mem_ptr_arg(&args[0]);
+        if (!QC_ISINT(c->a_type))
+                qcsyntax(QCE_TYPE_INVAL);
+        n = size_arg(&args[2]);
+        ret->a_value.p = memset(dst, c->a_value.i, n);
+}
+
+/* Equivalent to memcmp */
+void qccall_memcmp(Atom *args, int nargs, Atom *ret)
+{
+        void *s1, *s2;
+        size_t n;
+
+        s1 = mem_ptr_arg(&args[0]);
+        s2 = mem_ptr_arg(&args[1]);
+        n = size_arg(&args[2]);
+        ret->a_value.i = memcmp(s1, s2, n);
+}
+
+/*
+ *                      qsort() and friends
+ *
+ * These call a user function for each element of an array. QC has no
+ * function pointers, so the function is named by a string, and called
+ * through qc_call_function(). The array is given by a typed pointer to
+ * its first element, which sets the size of the elements, and their
+ * number.
+ */
+
+/* The function named by argument `a' */
+static Function *callback_arg(Atom *a)
+{
+        Function *f;
+
+        if (!QC_ISSTRING(a->a_type) || a->a_value.p == NULL)
+                qcsyntax(QCE_TYPE_INVAL);
+        f = qc_func_lookup((char *)a->a_value.p);
+        if (f == NULL)
+                qcsyntax(QCE_FUNC_UNDEF);
+        return f;
+}
+
+/* Size of the elements that pointer argument `a' points at */
+static size_t elem_size_arg(Atom *a)
+{
+        if (!QC_ISPTR(a->a_type) || QC_ISVOID(a->a_type & ~QC_PTR)
+            || a->a_value.p == NULL)
+                qcsyntax(QCE_TYPE_INVAL);
+        return qc_ptr_stride(a->a_type);
+}
+
+/* Return value `r' of a callback, as an int */
+static int callback_int(Atom *r)
+{
+        Atom i;
+
+        i.a_type = QC_INT;
+        qc_mov(&i, r);
+        return i.a_value.i;
+}
+
+/*
+ * The qsort() call that is running, for qsort_cmp(). A comparison
+ * function may call qsort() itself, so each call keeps the one it
+ * interrupted.
+ */
+static struct qsort_call_t {
+        Function *q_cmp;
+        qctoken_t q_type;
+} *qsort_call = NULL;
+
+static int qsort_cmp(const void *a, const void *b)
+{
+        Atom args[2], r;
+
+        args[0].a_type = qsort_call->q_type;
+        args[0].a_value.p = (void *)a;
+        args[1].a_type = qsort_call->q_type;
+        args[1].a_value.p = (void *)b;
+        qc_call_function(qsort_call->q_cmp, args, 2, &r);
+        return callback_int(&r);
+}
+
+/*
+ * Similar to qsort, but `qsort(p, n, "cmp")': the element size comes
+ * from the type of `p', and `cmp' gets pointers of that type.
+ */
+void qccall_qsort(Atom *args, int nargs, Atom *ret)
+{
+        struct qsort_call_t call, *save;
+        size_t size, n;
+
+        size = elem_size_arg(&args[0]);
+        n = size_arg(&args[1]);
+        call.q_cmp = callback_arg(&args[2]);
+        call.q_type = args[0].a_type;
+
+        save = qsort_call;
+        qsort_call = &call;
+        qsort(args[0].a_value.p, n, size, qsort_cmp);
+        qsort_call = save;
+        ret->a_value.i = 0;
+}
+
+/*
+ * `foreach(p, n, "visit")': call `visit' with a pointer to each of the
+ * `n' elements at `p', in order. Return the number of elements.
+ */
+void qccall_foreach(Atom *args, int nargs, Atom *ret)
+{
+        Function *f;
+        Atom elem, r;
+        size_t size, n, i;
+
+        size = elem_size_arg(&args[0]);
+        n = size_arg(&args[1]);
+        f = callback_arg(&args[2]);
+
+        elem.a_type = args[0].a_type;
+        for (i = 0; i < n; ++i) {
+                elem.a_value.p = (char *)args[0].a_value.p + i * size;
+                qc_call_function(f, &elem, 1, &r);
+        }
+        ret->a_value.i = n;
+}
+
+/*
+ * `map(p, n, "f")': replace each of the `n' elements at `p' with what
+ * `f' returns for it, cast to the element's type. Return the number of
+ * elements.
+ */
+void qccall_map(Atom *args, int nargs, Atom *ret)
+{
+        Function *f;
+        Atom elem, r;
+        qctoken_t type;
+        size_t size, n, i;
+        char *addr;
+
+        size = elem_size_arg(&args[0]);
+        n = size_arg(&args[1]);
+        f = callback_arg(&args[2]);
+        type = args[0].a_type & ~QC_PTR;
+        if (QC_ISSTRUCT(type))
+                qcsyntax(QCE_TYPE_INVAL);
+
+        for (i = 0; i < n; ++i) {
+                addr = (char *)args[0].a_value.p + i * size;
+                qc_load(&elem, addr, type);
+                qc_call_function(f, &elem, 1, &r);
+                qc_store(addr, type, &r);
+        }
+        ret->a_value.i = n;
+}
+
+/**
+ * @brief Free what is left of a Namespace's heap. The small blocks go
+ * with the Namespace's arena.
+ */
+void qclib_namespace_exit(Namespace *ns)
+{
+        struct qc_mbig_t *bg;
+
+        while ((bg = ns->heap.h_big) != NULL) {
+                ns->heap.h_big = bg->bg_next;
+                free(bg);
+        }
+        memset(ns->heap.h_free, 0, sizeof(ns->heap.h_free));
+        free(ns->heap.h_live);
+        ns->heap.h_live = NULL;
+        ns->heap.h_nlive = 0;
+        ns->heap.h_live_bits = 0;
 }
 
 /**
@@ -201,5 +799,6 @@ void qclib_exit(void)
                 if (*pfp != NULL)
                         fclose(*pfp);
         }
+        qsort_call = NULL;
         qclib_init();
 }
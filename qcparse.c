@@ -40,7 +40,9 @@ static struct qc_ikeyword_t {
         IKEY_PARAMS("double",      QC_DBL | QC_TYPE | QC_FLTFLG),
         IKEY_PARAMS("unsigned",    QC_UNSIGNED | QC_TYPE),
         IKEY_PARAMS("static",      QC_STATIC | QC_TYPE),
+        IKEY_PARAMS("const",       QC_CONST | QC_TYPE),
         IKEY_PARAMS("void",        QC_EMPTY | QC_TYPE | QC_VDFLG),
+        IKEY_PARAMS("struct",      QC_STRUCT | QC_TYPE | QC_STFLG),
         IKEY_PARAMS("NULL",        QC_NULL),
         IKEY_PARAMS("break",       QC_BREAK),
         IKEY_END,
@@ -62,38 +64,429 @@ static qctoken_t qc_ikeyword_lookup(char *s);
 char *qc_program_counter_save = NULL;
 
 
+/*
+ * Helper to array_offset_maybe(). If the array index is a lone variable,
+ * eg `a[i]', return that variable without evaluating an expression.
+ * The current token is the first token of the index.
+ */
+static Variable *array_index_var(void)
+{
+        Variable *iv;
+        char *p;
+
+        if (QC_TOK(qc_token) != QC_IDENTIFIER)
+                return NULL;
+
+        for (p = qc_program_counter; isspace(*p); ++p)
+                ;
+        if (*p != ']')
+                return NULL;
+
+        iv = qc_uvar_lookup(qc_token_string);
+        if (iv == NULL || QC_ISARRAY(iv) || !QC_ISINIT(iv)
+            || QC_TYPEOF(iv->v_type) != QC_INT)
+                return NULL;
+        return iv;
+}
+
+/*
+ * struct qc_ref_t - Where the parser found a datum that may be read or
+ * written: a variable, an array element, or the target of a pointer.
+ * @r_addr: Address of the datum
+ * @r_type: Type of the datum
+ * @r_var: The variable, if the datum is a whole named variable, so that
+ *      its QC_VFLAG_INITIALIZED flag is used. NULL otherwise; array
+ *      elements, struct members and pointer targets are not flagged.
+ * @r_decay: True if the datum is an array member of a struct, or a row
+ *      of an array with more than one dimension, with no index after
+ *      it. Like an array's name, it stands for a pointer to its first
+ *      element, which is at @r_addr.
+ * @r_rdonly: True if the datum is an element or member of a `const'
+ *      variable. (A whole variable is checked by assign_var_deref().)
+ */
+struct qc_ref_t {
+        void *r_addr;
+        qctoken_t r_type;
+        Variable *r_var;
+        int r_decay;
+        int r_rdonly;
+};
+
+/*
+ * Helper to array_offset_maybe(). Index through pointer `v', eg `p[i]',
+ * which is the same as `*(p + i)'. The current token is the `['. Like
+ * pointer math, this steps by the size of what `v' points at, and is not
+ * bounds-checked; QC does not know how big the buffer is.
+ */
+static void ptr_index(Variable *v, struct qc_ref_t *ref)
+{
+        Atom idx;
+
+        if (!QC_ISINIT(v))
+                qcsyntax(QCE_UNINIT);
+        ref->r_type = v->v_type & ~QC_PTR;
+        if (QC_ISVOID(ref->r_type))
+                qcsyntax(QCE_DEREF);
+        ref->r_var = NULL;
+        ref->r_rdonly = 0;
+
+        qc_lex();
+        evalexp0(&idx);
+        if (QC_TOK(qc_token) != QC_CLOSESQU)
+                qcsyntax(QCE_SQUBRACE_EXPECTED);
+        if (!QC_ISINT(idx.a_type))
+                qcsyntax(QCE_TYPE_INVAL);
+        ref->r_addr = (char *)v->v_value.p
+                      + (long)idx.a_value.i * qc_ptr_stride(v->v_type);
+        qc_lex();
+}
+
+/*
+ * Helper to array_offset_maybe(). Index array `v', which has more than
+ * one dimension, eg `m[i][j]'. The current token is the first `['. The
+ * element's offset in the flat storage is worked out in one pass over
+ * the indexes, row by row, and each index is checked against the size
+ * of its own dimension. With fewer indexes than dimensions, eg `m[i]',
+ * the datum is a row, which stands for a pointer to its first element,
+ * like an array's name.
+ */
+static void multi_index(Variable *v, struct qc_ref_t *ref)
+{
+        const size_t *dims = QC_ARRAY_DIMS(v);
+        Atom idx;
+        Variable *iv;
+        size_t off = 0;
+        int n = 0;
+
+        ref->r_var = NULL;
+        do {
+                qc_lex();
+                iv = array_index_var();
+                if (iv != NULL) {
+                        idx.a_value.i = iv->v_value.i;
+                        qc_lex();
+                } else {
+                        evalexp0(&idx);
+                }
+                if (QC_TOK(qc_token) != QC_CLOSESQU)
+                        qcsyntax(QCE_SQUBRACE_EXPECTED);
+                if ((unsigned int)idx.a_value.i >= dims[n])
+                        qcsyntax(QCE_ARRAY_BOUNDS);
+                off = off * dims[n++] + idx.a_value.i;
+                qc_lex();
+        } while (n < v->v_ndim && QC_TOK(qc_token) == QC_OPENSQU);
+
+        if (n < v->v_ndim)
+                ref->r_decay = 1;
+        for (; n < v->v_ndim; ++n)
+                off *= dims[n];
+        ref->r_addr = (char *)v->v_array + off * qc_type_size(v->v_type);
+}
+
 /**
  * array_offset_maybe - Dereference an array, if there is a `[' following
  * a variable name
  * @v: Variable to check if array offset
+ * @ref: Where to store the result
+ *
+ * The bounds check is skipped if the index is the induction variable of
+ * a running `for' loop, and the loop has been proven to keep it inside
+ * the array (see qc_loop_index_inbounds()), unless QC_BOUNDS_CHECK_ALWAYS
+ * is set. Such an element is then walked by the loop (see
+ * qc_loop_walker()), so the next time this index is reached its address
+ * is already known.
  *
- * Return: v, or v[`offset'] if the user code required an offset.
+ * If @v is a pointer rather than an array, the index is taken from where
+ * it points, see ptr_index(). If it has more than one dimension, see
+ * multi_index(); those are not walked.
+ *
+ * On return, @ref refers to v[`offset'] if the user code required an
+ * offset, or else to @v itself.
  */
-static Variable *array_offset_maybe(Variable *v)
+static void array_offset_maybe(Variable *v, struct qc_ref_t *ref)
 {
-        if (QC_TOK(qc_token) == QC_OPENSQU) {
-                Atom arrayidx;
-                if (!QC_ISARRAY(v))
+        Atom arrayidx;
+        Variable *iv;
+        char *site, *elem;
+        int inbounds;
+
+        ref->r_type = v->v_type;
+        ref->r_decay = 0;
+        if (QC_TOK(qc_token) != QC_OPENSQU) {
+                if (QC_ISSTRUCT(v->v_type)) {
+                        /* Its storage is where its members are */
+                        ref->r_addr = v->v_array;
+                        ref->r_var  = NULL;
+                } else {
+                        ref->r_addr = &v->v_value;
+                        ref->r_var  = v;
+                }
+                return;
+        }
+
+        if (!QC_ISARRAY(v)) {
+                if (!QC_ISPTR(v->v_type))
                         qcsyntax(QCE_TYPE_INVAL);
+                ptr_index(v, ref);
+                return;
+        }
+        if (v->v_ndim != 0) {
+                multi_index(v, ref);
+                return;
+        }
+        ref->r_var = NULL;
 
+        site = qc_program_counter;
+        ref->r_addr = qc_loop_walker(site, v);
+        if (ref->r_addr != NULL) {
                 qc_lex();
-                evalexp0(&arrayidx);
-                if (QC_TOK(qc_token) != QC_CLOSESQU)
-                        qcsyntax(QCE_SQUBRACE_EXPECTED);
+                return;
+        }
+
+        qc_lex();
+        iv = array_index_var();
+        if (iv != NULL) {
+                arrayidx.a_value.i = iv->v_value.i;
                 qc_lex();
+        } else {
+                evalexp0(&arrayidx);
+        }
+        if (QC_TOK(qc_token) != QC_CLOSESQU)
+                qcsyntax(QCE_SQUBRACE_EXPECTED);
 
-                if (arrayidx.a_value.i >= v->v_asize)
-                        qcsyntax(QCE_ARRAY_BOUNDS);
-                /* Closing brace should have been
-                 * passed when evaluating arrayidx
-                 */
-                /*
-                 * FIXME: This only works for local variables.
-                 * It should check v->v_array for global variables.
-                 */
-                v += arrayidx.a_value.i;
+        inbounds = qc_loop_index_inbounds(iv, v->v_asize);
+        if ((QC_BOUNDS_CHECK_ALWAYS || !inbounds)
+            && (unsigned int)arrayidx.a_value.i >= v->v_asize) {
+                qcsyntax(QCE_ARRAY_BOUNDS);
+        }
+
+        elem = (char *)v->v_array
+               + arrayidx.a_value.i * qc_type_size(v->v_type);
+        if (inbounds && !QC_BOUNDS_CHECK_ALWAYS)
+                qc_loop_walker_add(site, qc_program_counter, v, iv, elem);
+        ref->r_addr = elem;
+        qc_lex();
+}
+
+/*
+ * Helper to member_maybe(). Index the array member that `ref' refers
+ * to, which has `n' elements, if there is a `[' following it.
+ */
+static void member_index(struct qc_ref_t *ref, size_t n)
+{
+        Atom idx;
+
+        if (QC_TOK(qc_token) != QC_OPENSQU) {
+                ref->r_decay = 1;
+                return;
+        }
+
+        qc_lex();
+        evalexp0(&idx);
+        if (QC_TOK(qc_token) != QC_CLOSESQU)
+                qcsyntax(QCE_SQUBRACE_EXPECTED);
+        if ((unsigned int)idx.a_value.i >= n)
+                qcsyntax(QCE_ARRAY_BOUNDS);
+        ref->r_addr = (char *)ref->r_addr
+                      + idx.a_value.i * qc_type_size(ref->r_type);
+        qc_lex();
+}
+
+/**
+ * member_maybe - Follow struct member accesses, if there is a `.' or `->'
+ * following a datum
+ * @ref: The datum, as found by array_offset_maybe() or by an earlier
+ *      member access
+ *
+ * The member's offset is looked up only the first time it is reached
+ * from here; see qc_struct_member().
+ *
+ * On return, @ref refers to the last member accessed, or is unchanged
+ * if there was none.
+ */
+static void member_maybe(struct qc_ref_t *ref)
+{
+        const struct qc_field_t *f;
+        Atom ptr;
+        char *base;
+        int tok;
+
+        while ((tok = QC_TOK(qc_token)) == QC_DOT || tok == QC_ARROW) {
+                if (ref->r_decay)
+                        qcsyntax(QCE_TYPE_INVAL);
+
+                if (tok == QC_DOT) {
+                        if (!QC_ISSTRUCT(ref->r_type))
+                                qcsyntax(QCE_TYPE_INVAL);
+                        base = ref->r_addr;
+                } else {
+                        if (!QC_ISPTR(ref->r_type)
+                            || !QC_ISSTRUCT(ref->r_type & ~QC_PTR))
+                                qcsyntax(QCE_DEREF);
+                        if (ref->r_var != NULL && !QC_ISINIT(ref->r_var))
+                                qcsyntax(QCE_UNINIT);
+                        qc_load(&ptr, ref->r_addr, ref->r_type);
+                        if (ptr.a_value.p == NULL)
+                                qcsyntax(QCE_DEREF);
+                        base = ptr.a_value.p;
+                        ref->r_rdonly = 0;
+                }
+
+                f = qc_struct_member(ref->r_type);
+                ref->r_addr = base + f->f_offset;
+                ref->r_type = f->f_type;
+                ref->r_var  = NULL;
+                if (f->f_asize != 0)
+                        member_index(ref, f->f_asize);
+        }
+}
+
+/*
+ * Find the datum that variable `v' refers to, along with any array index
+ * and struct members after its name.
+ */
+static void var_ref(Variable *v, struct qc_ref_t *ref)
+{
+        ref->r_rdonly = QC_ISRDONLY(v);
+        array_offset_maybe(v, ref);
+        member_maybe(ref);
+}
+
+/*
+ * Get the value of an array's name without brackets, which, like in
+ * ordinary C, is a pointer to its first element.
+ */
+static void array_decay(Atom *a, Variable *v)
+{
+        if (QC_ISPTR(v->v_type))
+                qcsyntax(QCE_DBL_PTR);
+        a->a_type = v->v_type | QC_PTR;
+        a->a_value.p = v->v_array;
+}
+
+/*
+ * Assign `v' to the datum referred to by `ref', casting it to the
+ * datum's type.
+ */
+static void ref_store(struct qc_ref_t *ref, Atom *v)
+{
+        Variable *var = ref->r_var;
+
+        if (var != NULL) {
+                /* Cannot assign an array's name */
+                if (QC_ISARRAY(var))
+                        qcsyntax(QCE_TYPE_INVAL);
+                assign_var_deref(var, v);
+        } else {
+                if (ref->r_decay)
+                        qcsyntax(QCE_TYPE_INVAL);
+                if (ref->r_rdonly)
+                        qcsyntax(QCE_CONST_ASSIGN);
+                qc_store(ref->r_addr, ref->r_type, v);
         }
-        return v;
+}
+
+
+/* **********************************************************************
+ *            Section: The `int' fast path
+ ***********************************************************************/
+
+/*
+ * Most operations at run time are `int' op `int'. The helpers below try
+ * those first, doing the operation and the crop right here, instead of
+ * going through the type dispatch in qcinst.c. They return false for
+ * anything else, so the caller falls back to qc_add(), qc_cmp(), etc.
+ * The results must match those of qcinst.c exactly.
+ */
+static inline int int_fast_arith(Atom *a, Atom *b, int op)
+{
+        long long l, r;
+
+        if (!QC_BOTH_INT(a, b))
+                goto slow;
+
+        l = a->a_value.i;
+        r = b->a_value.i;
+        switch (op) {
+        case QC_PLUSTOK:
+                l += r;
+                break;
+        case QC_MINUSTOK:
+                l -= r;
+                break;
+        case QC_MULTOK:
+                l *= r;
+                break;
+        case QC_DIVTOK:
+                if (r == 0)
+                        goto slow;
+                l /= r;
+                break;
+        case QC_MODTOK:
+                if (r == 0)
+                        goto slow;
+                l %= r;
+                break;
+        case QC_ANDTOK:
+                l &= r;
+                break;
+        case QC_ORTOK:
+                l |= r;
+                break;
+        case QC_XORTOK:
+                l ^= r;
+                break;
+        default:
+                goto slow;
+        }
+        a->a_value.ulli = 0ULL;
+        a->a_value.i = (int)l;
+        ++qc_stats.s_int_fast;
+        return 1;
+
+slow:
+        ++qc_stats.s_int_slow;
+        return 0;
+}
+
+/* Same as int_fast_arith(), but for relational operators */
+static inline int int_fast_cmp(Atom *a, Atom *b, int op, int *result)
+{
+        int l, r;
+
+        if (!QC_BOTH_INT(a, b))
+                goto slow;
+
+        l = a->a_value.i;
+        r = b->a_value.i;
+        switch (op) {
+        case QC_LT:
+                *result = l < r;
+                break;
+        case QC_LE:
+                *result = l <= r;
+                break;
+        case QC_GT:
+                *result = l > r;
+                break;
+        case QC_GE:
+                *result = l >= r;
+                break;
+        case QC_EQ:
+                *result = l == r;
+                break;
+        case QC_NE:
+                *result = l != r;
+                break;
+        default:
+                goto slow;
+        }
+        ++qc_stats.s_int_fast;
+        return 1;
+
+slow:
+        ++qc_stats.s_int_slow;
+        return 0;
 }
 
 
@@ -155,7 +548,8 @@ static void qcparse_assign(Atom *dst, Atom *operand, int asgn)
  * @a: the same Atom that is passed down through the recursive
  * decsent parser. If the return value is true, `a' will hold the final
  * result (eg for `x += y;' `a' will hold the value of x + y).
- *  @var: variable to assign the result.
+ *  @ref: variable, array element, or pointer target to assign the
+ *  result.
  *
  * Assign a variable, code that is common to both pointer de-referencing
  * and to name-identified variable dereferencing. This also processes
@@ -165,26 +559,18 @@ static void qcparse_assign(Atom *dst, Atom *operand, int asgn)
  * The program state should have been saved in a struct qc_program_t
  * before calling this function, and restored if it returns FALSE. If
  * the assignment is not a simple `=' (EG it is something like `+=') and
- * `var' has not been initialized, `var' will be assigned an undefined
+ * `ref' has not been initialized, `ref' will be assigned an undefined
  * value and flagged as `initialized', without warning.
  *
  * Return: true (1) if an assignment was made; false (0) if not.
  */
-static int qcparse_assign_maybe(Atom *a, Variable *var)
+static int qcparse_assign_maybe(Atom *a, struct qc_ref_t *ref)
 {
         Atom ta;
         int assignment;
-        /*
-         * If an array, de-reference it. The downside of this is that
-         * we have to undo and redo all of this if it is not an
-         * assignment.
-         *
-         * XXX: DRY alert.
-         */
-        var = array_offset_maybe(var);
 
         if (QC_ISASGN_OP(qc_token)) {
-                memcpy(a, &var->v_datum, sizeof(Atom));
+                qc_load(a, ref->r_addr, ref->r_type);
                 switch (QC_TOK(qc_token)) {
                 case QC_PLUSPLUS:
                         ta.a_value.lli = 1;
@@ -211,7 +597,7 @@ static int qcparse_assign_maybe(Atom *a, Variable *var)
                  * assign it to the actual variable `var'.
                  */
                 qcparse_assign(a, &ta, assignment);
-                assign_var_deref(var, a);
+                ref_store(ref, a);
                 return 1;
         }
 
@@ -220,11 +606,9 @@ static int qcparse_assign_maybe(Atom *a, Variable *var)
 
 /*
  * Evaluate a pointer expression (minus the opening asterisk, which we
- * already know about), and return the Variable being pointed at. This
- * has undefined behavior if the pointer is not to a user-defined
- * variable.
+ * already know about), and store what it points at in `ref'.
  */
-static Variable *ptr2var(void)
+static void ptr2ref(struct qc_ref_t *ref)
 {
         Atom varptr;
 
@@ -243,22 +627,27 @@ static Variable *ptr2var(void)
         if (!QC_ISPTR(varptr.a_type))
                 qcsyntax(QCE_SYNTAX);
 
-        return (Variable *)(varptr.a_value.p);
+        ref->r_addr  = varptr.a_value.p;
+        ref->r_type  = varptr.a_type & ~QC_PTR;
+        ref->r_var   = NULL;
+        ref->r_decay = 0;
+        ref->r_rdonly = 0;
+        if (QC_ISVOID(ref->r_type))
+                qcsyntax(QCE_DEREF);
 }
 
 /*
  * Pre-increment or -decrement a variable.
  */
-static void plusplusvar(Atom *a, Variable *var, int plusminus)
+static void plusplusvar(Atom *a, struct qc_ref_t *ref, int plusminus)
 {
         Atom ta;
 
-        memcpy(a, &var->v_datum, sizeof(Atom));
+        qc_load(a, ref->r_addr, ref->r_type);
         ta.a_value.lli = 1;
         ta.a_type      = QC_INT;
-        qc_lex();
         qcparse_assign(a, &ta, plusminus);
-        assign_var_deref(var, a);
+        ref_store(ref, a);
 }
 
 /*
@@ -269,20 +658,22 @@ static void plusplusvar(Atom *a, Variable *var, int plusminus)
  */
 static void preincrement(Atom *a, int plusminus)
 {
+        struct qc_ref_t ref;
         Variable *var;
 
         qc_lex();
         if (QC_TOK(qc_token) == QC_MULTOK) {
-                var = ptr2var();
-                plusplusvar(a, var, plusminus);
+                ptr2ref(&ref);
         } else if (QC_TOK(qc_token) == QC_IDENTIFIER) {
                 var = qc_uvar_lookup(qc_token_string);
                 if (var == NULL)
                         qcsyntax(QCE_SYNTAX);
-                plusplusvar(a, var, plusminus);
+                qc_lex();
+                var_ref(var, &ref);
         } else {
                 qcsyntax(QCE_SYNTAX);
         }
+        plusplusvar(a, &ref, plusminus);
 }
 
 /*
@@ -294,6 +685,7 @@ static void preincrement(Atom *a, int plusminus)
 static void evalexp0(Atom *a)
 {
         struct qc_program_t buf;
+        struct qc_ref_t ref;
         Variable *var;
         qctoken_t type;
 
@@ -305,22 +697,33 @@ static void evalexp0(Atom *a)
          * look for them here.
          */
         if (type == QC_IDENTIFIER) {
-                var = qc_uvar_lookup(qc_token_string);
+                /* A folded `const' is never assigned here, see
+                 * qc_fold_consts() */
+                if (qc_fold_lookup(qc_program_counter_save) != NULL)
+                        var = NULL;
+                else
+                        var = qc_uvar_lookup(qc_token_string);
                 if (var != NULL) {
                         /* token is a variable name */
-                        a->a_type = var->v_type;
-
                         qc_program_save(&buf);
                         qc_lex();
 
-                        if (qcparse_assign_maybe(a, var))
+                        /*
+                         * If an array, de-reference it. The downside of
+                         * this is that we have to undo and redo all of
+                         * this if it is not an assignment.
+                         *
+                         * XXX: DRY alert.
+                         */
+                        var_ref(var, &ref);
+                        if (qcparse_assign_maybe(a, &ref))
                                 return;
                         qc_program_restore(&buf);
                 }
         } else if (type == QC_MULTOK) {
                 qc_program_save(&buf);
-                var = ptr2var();
-                if (qcparse_assign_maybe(a, var))
+                ptr2ref(&ref);
+                if (qcparse_assign_maybe(a, &ref))
                         return;
                 qc_program_restore(&buf);
         } else if (type == QC_PLUSPLUS) {
@@ -378,6 +781,9 @@ static void evalexp2(Atom *a)
                 qc_lex();
                 evalexp3(&partial);
 
+                if (int_fast_arith(a, &partial, c))
+                        continue;
+
                 switch (c) {
                 case QC_ANDTOK:
                         qc_and(a, &partial);
@@ -413,7 +819,8 @@ static void evalexp3(Atom *a)
                 qc_lex();
                 evalexp4(&partial);
 
-                result = qc_cmp(a, &partial, op);
+                if (!int_fast_cmp(a, &partial, op, &result))
+                        result = qc_cmp(a, &partial, op);
 
                 a->a_value.i = result;
                 /* This recasts expression to `int', now. We should only
@@ -459,6 +866,9 @@ static void evalexp5(Atom *a)
                 qc_lex();
                 evalexp6(&partial);
 
+                if (int_fast_arith(a, &partial, op))
+                        continue;
+
                 if (op == QC_PLUSTOK)
                         qc_add(a, &partial);
                 else /* op == QC_MINUSTOK */
@@ -478,6 +888,9 @@ static void evalexp6(Atom *a)
                 qc_lex();
                 evalexp7(&partial);
 
+                if (int_fast_arith(a, &partial, op))
+                        continue;
+
                 switch (op) {
                 case QC_MULTOK:
                         qc_mul(a, &partial);
@@ -498,6 +911,8 @@ static void evalexp7(Atom *a)
         register char op;
         Atom tmp;
         Variable *p;
+        struct qc_ref_t ref;
+        qctoken_t type;
 
         op = QC_TOK(qc_token);
 
@@ -523,21 +938,14 @@ static void evalexp7(Atom *a)
                         evalexp7(a);
 
                         /* a <= dereference(a) */
-                        p = (Variable *)a->a_value.p;
-
                         if (!QC_ISPTR(a->a_type))
                                 qcsyntax(QCE_DEREF);
 
-                        if (qc_uvar_bound_check(p))
-                                qcsyntax(QCE_BOUND_ERR);
-
-                        if (!QC_ISINIT(p))
-                                qcsyntax(QCE_UNINIT);
+                        type = a->a_type & ~QC_PTR;
+                        if (QC_ISVOID(type))
+                                qcsyntax(QCE_DEREF);
 
-                        /* This casts a copy of p into a-type (minus the
-                         * pointer) before copying it into a */
-                        a->a_type = p->v_type;
-                        qc_mov(a, &p->v_datum);
+                        qc_load(a, a->a_value.p, type);
                         break;
                 case QC_LNOTTOK:
                         evalexp8(a);
@@ -556,11 +964,21 @@ static void evalexp7(Atom *a)
                         p = qc_uvar_lookup(qc_token_string);
                         if (p == NULL)
                                 qcsyntax(QCE_SYNTAX);
+                        /* Anything may now write to it via pointer, so
+                         * treat it as initialized from here on. */
+                        p->v_flag |= QC_VFLAG_ADDRTAKEN
+                                     | QC_VFLAG_INITIALIZED;
                         qc_lex();
-                        p = array_offset_maybe(p);
+                        if (QC_ISARRAY(p) && QC_TOK(qc_token) != QC_OPENSQU) {
+                                array_decay(a, p);
+                                break;
+                        }
+                        var_ref(p, &ref);
+                        if (QC_ISPTR(ref.r_type))
+                                qcsyntax(QCE_DBL_PTR);
 
-                        a->a_type = p->v_type | QC_PTR;
-                        a->a_value.p = p;
+                        a->a_type = ref.r_type | QC_PTR;
+                        a->a_value.p = ref.r_addr;
                         break;
                 default:
                         /* Unary `+', other ignores */
@@ -615,10 +1033,20 @@ static void qc_atom(Atom *a)
 {
         Function *f;
         Variable *v;
+        struct qc_ref_t ref;
+        const struct qc_fold_t *cf;
         char *endptr = NULL;
 
         switch (QC_TOK(qc_token)) {
         case QC_IDENTIFIER:
+                cf = qc_fold_lookup(qc_program_counter_save);
+                if (cf != NULL) {
+                        /* `const' whose value was folded in at load */
+                        *a = cf->cf_value;
+                        ++qc_stats.s_const_fold;
+                        qc_lex();
+                        return;
+                }
                 f = qc_func_lookup(qc_token_string);
                 if (f != NULL) {
                         /* a will be type-changed into
@@ -632,21 +1060,32 @@ static void qc_atom(Atom *a)
                         if (v == NULL)
                                 qcsyntax(QCE_SYNTAX);
                         qc_lex();
-                        v = array_offset_maybe(v);
-                        if (!QC_ISINIT(v)) {
+                        if (QC_ISARRAY(v) && QC_TOK(qc_token) != QC_OPENSQU) {
+                                array_decay(a, v);
+                                return;
+                        }
+                        var_ref(v, &ref);
+                        if (ref.r_decay) {
+                                if (QC_ISPTR(ref.r_type))
+                                        qcsyntax(QCE_DBL_PTR);
+                                a->a_type = ref.r_type | QC_PTR;
+                                a->a_value.p = ref.r_addr;
+                                return;
+                        }
+                        if (ref.r_var != NULL && !QC_ISINIT(v)) {
                                 /* Trying to get the value of an
                                  * uninitialized variable */
                                 qcsyntax(QCE_UNINIT);
                         }
                         /* get a's value */
-                        a->a_type = v->v_type;
-                        qc_mov(a, &v->v_datum);
+                        qc_load(a, ref.r_addr, ref.r_type);
                 }
                 return;
 
         case QC_NULL:
                 a->a_value.p = NULL;
                 a->a_type    = QC_PTR | QC_CHAR;
+                qc_lex();
                 return;
 
         case QC_NUMBER:
@@ -666,9 +1105,9 @@ static void qc_atom(Atom *a)
                 return;
 
         case QC_STRING:
-                a->a_type = qc_token;
+                a->a_type = QC_CHARPTR;
                 a->a_value.p = qc_token_string;
-                /* XXX: No new qc_lex()? */
+                qc_lex();
                 return;
 
         default:
@@ -877,6 +1316,10 @@ qctoken_t qc_lex(void)
                                 ++qc_program_counter;
                                 qc_token = QC_MINUSMINUS;
                                 goto done;
+                        } else if (*qc_program_counter == '>') {
+                                ++qc_program_counter;
+                                qc_token = QC_ARROW;
+                                goto done;
                         }
                         goto single;
                 case '*':
@@ -946,10 +1389,11 @@ qctoken_t qc_lex(void)
         }
 
         if (isdigit(*qc_program_counter)) {
-                /* XXX: If we support structs, need way of sliding over
-                 * decimal `.' character.
-                 * Need way of sliding over `-' in case of exponent */
-                while (!QCCHAR_ISDELIM(*qc_program_counter))
+                /* `.' is a delimiter, for struct members, but not
+                 * inside a number.
+                 * XXX: Need way of sliding over `-' in case of exponent */
+                while (!QCCHAR_ISDELIM(*qc_program_counter)
+                       || *qc_program_counter == '.')
                         *s++ = *qc_program_counter++;
                 *s = '\0';
                 qc_token = QC_NUMBER;
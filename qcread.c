@@ -43,6 +43,7 @@ do {                                                  \
 
 char *qc_program_counter;
 jmp_buf qc_jmp_buf;
+struct qc_stats_t qc_stats;
 Namespace *qc_namespace = NULL;
 Namespace *qc_namespace_list = NULL;
 
@@ -63,7 +64,7 @@ char *qc_token_string;
  */
 char qc_token_string_buffer[TOKEN_LEN];
 
-static int load_program(FILE *fp, Namespace *ns);
+static int load_program(FILE *fp, Namespace *ns, size_t size);
 static int prescan(void);
 static int exec_if(void);
 static int exec_while(void);
@@ -72,6 +73,60 @@ static void find_eob(void);
 static int exec_for(void);
 static void qc_cleanup(void);
 static int qc_hash_string(Namespace *ns, FILE *fp, char *s, int n);
+static int ustring_index(Namespace *ns);
+
+/*
+ * struct qc_loop_t - Result of analyzing a `for' loop header and body
+ * @l_pc: Location of the loop header in the program buffer, used as the
+ *      key into loop_cache. NULL if the cache entry is empty.
+ * @l_name: Name of the induction variable
+ * @l_lo: First value of the induction variable
+ * @l_hi: One past the last value of the induction variable
+ * @l_canon: True if the loop has the form
+ *      `for (i = LO; i < HI; ++i)' (or `i <= HI', `i++', `i += 1')
+ *      and its body never writes to, takes the address of, or
+ *      re-declares `i'.
+ */
+struct qc_loop_t {
+        char *l_pc;
+        char l_name[ID_LEN + 1];
+        int l_lo;
+        int l_hi;
+        int l_canon;
+};
+
+/*
+ * struct qc_loop_walk_t - An array element walked by an induction
+ * variable, eg `a[i]' inside `for (i = 0; i < 8; ++i)'.
+ * @w_site: Location of the index expression in the program buffer
+ * @w_end: Location just past the closing `]'
+ * @w_array: The array being indexed
+ * @w_elem: Address of the element the index currently points at. This
+ *      is advanced by one element each time the induction variable is
+ *      incremented, so it never needs to be recomputed from the index.
+ */
+struct qc_loop_walk_t {
+        char *w_site;
+        char *w_end;
+        Variable *w_array;
+        char *w_elem;
+};
+
+/*
+ * struct qc_loop_range_t - Range of an induction variable, valid while
+ * its loop is running.
+ */
+struct qc_loop_range_t {
+        Variable *r_var;
+        int r_lo;
+        int r_hi;
+        int r_nwalk;
+        struct qc_loop_walk_t r_walk[QC_LOOP_WALKERS];
+};
+
+static struct qc_loop_t loop_cache[QC_LOOP_CACHE];
+static struct qc_loop_range_t loop_range_stack[FOR_NEST];
+static int loop_range_tos = 0;
 
 /**
  * qc_interpret_block - Interpret a single statement or block of code
@@ -159,10 +214,42 @@ returnfromblock:
         return -1;
 }
 
+/*
+ * Buffer that qc_hash_string() converts string literals in, grown as
+ * needed. It is freed after each file is loaded.
+ */
+static char *hs_buf = NULL;
+static size_t hs_size = 0;
+
+static void hs_free(void)
+{
+        free(hs_buf);
+        hs_buf = NULL;
+        hs_size = 0;
+}
+
+/* Double the size of hs_buf. `dst' points into it, and is updated. */
+static int hs_grow(char **dst)
+{
+        size_t used = *dst - hs_buf;
+        size_t size = hs_size ? 2 * hs_size : QC_STRING_LEN;
+        char *new;
+
+        new = realloc(hs_buf, size);
+        if (new == NULL)
+                return -QCE_NOMEM;
+        hs_buf = new;
+        hs_size = size;
+        *dst = hs_buf + used;
+        return 0;
+}
+
 /**
  * load_program - Load a program.
  * @fp: File to load
  * @ns: Namespace to load @fp into
+ * @size: Size of @ns's program buffer, not counting room for the
+ *      terminating nul char
  *
  * This is called during initialization, before the prescan. It filters
  * out comments and hashes string literals, converting them into C
@@ -178,9 +265,9 @@ returnfromblock:
  * Return value:
  *    zero or a negative enum QC_ERROR_T.
  */
-static int load_program(FILE *fp, Namespace *ns)
+static int load_program(FILE *fp, Namespace *ns, size_t size)
 {
-        int i = 0;
+        size_t i = 0;
         int c;
         int ret;
         char *p = &ns->program_buffer[0];
@@ -218,7 +305,7 @@ static int load_program(FILE *fp, Namespace *ns)
                         *p = c;
                         ++p;
                         ++i;
-                        ret = qc_hash_string(ns, fp, p, PROG_SIZE - i);
+                        ret = qc_hash_string(ns, fp, p, size - i);
                         if (ret < 0)
                                 goto err;
                         p += ret;
@@ -238,16 +325,21 @@ static int load_program(FILE *fp, Namespace *ns)
                 *p = c;
                 ++p;
                 ++i;
-        } while (!feof(fp) && i < PROG_SIZE);
+        } while (!feof(fp) && i < size);
 
-        if (*(p - 2) == 0x1A)
+        if (i > 1 && *(p - 2) == 0x1A)
                 *(p - 2) = '\0';
         else
                 *(p - 1) = '\0';
+        ret = ustring_index(ns);
+        if (ret)
+                goto err;
         fclose(fp);
+        hs_free();
         return 0;
 err:
         fclose(fp);
+        hs_free();
         qc_program_counter = p;
         return ret;
 }
@@ -286,14 +378,22 @@ static int prescan(void)
                 qc_lex();
 
                 if (QC_ISTYPE(qc_token)) {
-                        qcputback();
-
-                        p2 = qc_program_counter;
+                        p2 = qc_program_counter_save;
                         while (QC_ISTYPE(qc_token)
                             || QC_TOK(qc_token) == QC_MULTOK) {
+                                /* The tag is part of a struct type */
+                                if (QC_TOK(qc_token) == QC_STRUCT)
+                                        qc_lex();
                                 qc_lex();
                         }
 
+                        if (QC_TOK(qc_token) == QC_OPENBR) {
+                                /* `struct tag {' */
+                                qc_program_counter = p2;
+                                qc_struct_declare();
+                                continue;
+                        }
+
                         if (QC_TOK(qc_token) != QC_IDENTIFIER)
                                 qcsyntax(QCE_SYNTAX);
 
@@ -303,6 +403,7 @@ static int prescan(void)
                         switch (QC_TOK(qc_token)) {
                         case QC_SEMI:
                         case QC_EQEQ:
+                        case QC_OPENSQU:
                                 qc_decl_global();
                                 break;
                         case QC_OPENPAREN:
@@ -318,28 +419,93 @@ static int prescan(void)
                 }
         } while (QC_TOK(qc_token) != QC_FINISHED);
 
+        qc_fold_consts();
         qc_program_counter = p;
         return 0;
 }
 
-int qc_find_ustring(const char *s)
+/* Slot in a Namespace's ustring_idx to start looking for offset `off' */
+static inline size_t ustring_home(const Namespace *ns, size_t off)
+{
+        return (size_t)((off * 0x9E3779B97F4A7C15ULL)
+                        >> (64 - ns->ustring_bits));
+}
+
+/*
+ * Build the index of ns's string literals by location, for
+ * qc_find_ustring(). This is an open-addressed hash table of indexes
+ * into ns->ustrings, at most half full, keyed by the offset of the
+ * literal in the program buffer.
+ *
+ * Return: Zero, or -QCE_NOMEM
+ */
+static int ustring_index(Namespace *ns)
 {
+        size_t mask, off, j;
         int i;
-        struct qc_ustring_t *p;
 
-        i = 0;
-        p = qc_namespace->ustrings;
+        ns->ustring_bits = 1;
+        while ((1 << ns->ustring_bits) < 2 * ns->n_ustrings)
+                ++ns->ustring_bits;
+        mask = ((size_t)1 << ns->ustring_bits) - 1;
+
+        ns->ustring_idx = qc_arena_alloc(&ns->arena,
+                                         (mask + 1) * sizeof(int));
+        if (ns->ustring_idx == NULL)
+                return -QCE_NOMEM;
+        memset(ns->ustring_idx, -1, (mask + 1) * sizeof(int));
+
+        for (i = 0; i < ns->n_ustrings; ++i) {
+                off = ns->ustrings[i].p - ns->program_buffer;
+                for (j = ustring_home(ns, off); ns->ustring_idx[j] >= 0;
+                     j = (j + 1) & mask)
+                        ;
+                ns->ustring_idx[j] = i;
+        }
+        return 0;
+}
+
+/**
+ * qc_find_ustring - Find a string literal
+ * @s: Location of the literal in the current namespace's program buffer,
+ *      just after the opening quote
+ *
+ * Return: Index of the literal in qc_namespace->ustrings
+ */
+int qc_find_ustring(const char *s)
+{
+        Namespace *ns = qc_namespace;
+        size_t mask = ((size_t)1 << ns->ustring_bits) - 1;
+        size_t j;
+        int i;
 
-        while (i < qc_namespace->n_ustrings) {
-                if (p->p == s)
+        j = ustring_home(ns, s - ns->program_buffer);
+        while ((i = ns->ustring_idx[j]) >= 0) {
+                if (ns->ustrings[i].p == s)
                         return i;
-                ++i;
-                ++p;
+                j = (j + 1) & mask;
         }
         qcsyntax(QCE_FATAL);
         return -1;
 }
 
+/* Make room for another string literal in `ns' */
+static int ustring_grow(Namespace *ns)
+{
+        struct qc_ustring_t *new;
+        int max;
+
+        max = ns->max_ustrings ? 2 * ns->max_ustrings : QC_N_STRINGS;
+        new = qc_arena_alloc(&ns->arena, max * sizeof(*new));
+        if (new == NULL)
+                return -QCE_NOMEM;
+        if (ns->n_ustrings > 0)
+                memcpy(new, ns->ustrings, ns->n_ustrings * sizeof(*new));
+        ns->ustrings = new;
+        ns->max_ustrings = max;
+        return 0;
+}
+
 /**
  * qc_hash_string - Put the strings from an input file into a lookup table.
  * @ns: Namespace
@@ -373,17 +539,21 @@ static int qc_hash_string(Namespace *ns, FILE *fp, char *s, int n)
 {
         #define QCHS_GETC() QCREAD_GETC(c, fp, s, count, n)
         #define QCHS_CHECK_EOF() QCREAD_CHECK_EOF(c, fp);
+        /* Put a converted char, growing the buffer as needed */
+        #define QCHS_PUTC(c_)                                   \
+        do {                                                    \
+                if (dst == hs_buf + hs_size && hs_grow(&dst))   \
+                        return -QCE_NOMEM;                      \
+                *dst++ = (c_);                                  \
+        } while (0)
 
-        char buf[QC_STRING_LEN];
         int c, count = 0;
-        char *dst = buf;
+        char *dst = hs_buf;
         char *ssave = s;
         int octal, octcount;
 
-        if (n > (QC_STRING_LEN - 1))
-                n = QC_STRING_LEN - 1;
-        if (ns->n_ustrings == QC_N_STRINGS)
-                return -QCE_TOO_MANY_STRINGS;
+        if (ns->n_ustrings == ns->max_ustrings && ustring_grow(ns))
+                return -QCE_NOMEM;
 
         c = QCHS_GETC();
 
@@ -393,11 +563,11 @@ loop:
                         c = QCHS_GETC();
                         switch (c) {
                         case 'n':
-                                *dst++ = '\n';
+                                QCHS_PUTC('\n');
                                 c = QCHS_GETC();
                                 break;
                         case 't':
-                                *dst++ = '\t';
+                                QCHS_PUTC('\t');
                                 c = QCHS_GETC();
                                 break;
                         case '0':
@@ -416,24 +586,24 @@ loop:
                                         QCREAD_CHECK_LEN(count, n);
                                 }
                                 QCHS_CHECK_EOF();
-                                *dst++ = octal;
+                                QCHS_PUTC(octal);
                                 /* c is either not octal or after limit,
                                  * so we need to try again with this new
                                  * character. */
                                 goto loop;
                         case '\\':
-                                *dst++ = '\\';
+                                QCHS_PUTC('\\');
                                 c = QCHS_GETC();
                                 break;
                         case '"':
                                 /* This also prevents early finish in
                                  * case of `\"'. */
-                                *dst++ = '"';
+                                QCHS_PUTC('"');
                                 c = QCHS_GETC();
                                 break;
                         case '\r':
                                 /* Oh, the hell with it */
-                                *dst++ = '\r';
+                                QCHS_PUTC('\r');
                                 c = QCHS_GETC();
                                 break;
                         case EOF:
@@ -446,17 +616,17 @@ loop:
                 } else if (c == '\0' || c == EOF) {
                         goto erreof;
                 } else {
-                        *dst++ = c;
+                        QCHS_PUTC(c);
                         c = QCHS_GETC();
                 }
         }
 
         if (c != '"')
                 return -QCE_OVERSIZE_STRING;
-        *dst = '\0';
+        QCHS_PUTC('\0');
 
         /* Finished with dst, use it for creating the string */
-        dst = strdup(buf);
+        dst = qc_arena_strdup(&ns->arena, hs_buf);
         if (dst == NULL)
                 return -QCE_NOMEM;
         ns->ustrings[ns->n_ustrings].p = ssave;
@@ -623,6 +793,270 @@ static void find_eob(void)
         }
 }
 
+/*
+ * Helper to loop_analyze(). Get the value of a numerical literal
+ * token, or return false if the token is something else.
+ */
+static int loop_literal(int *val)
+{
+        char *endptr;
+        long long v;
+
+        if (QC_TOK(qc_token) != QC_NUMBER)
+                return 0;
+        v = strtoll(qc_token_string, &endptr, 0);
+        if (*endptr != '\0' || v < -0x7FFFFFFFLL || v > 0x7FFFFFFFLL)
+                return 0;
+        *val = (int)v;
+        return 1;
+}
+
+/*
+ * Helper to loop_analyze(). Scan a loop body from the program counter
+ * to the end of its block. Return true if variable `name' is written
+ * to, incremented, re-declared, or has its address taken anywhere in the
+ * body.
+ */
+static int loop_body_writes(const char *name)
+{
+        char *start, *end;
+        qctoken_t prev = 0;
+        int isname = 0;
+        int isdecl = 0;
+
+        start = qc_program_counter;
+        find_eob();
+        end = qc_program_counter;
+        qc_program_counter = start;
+
+        while (qc_program_counter < end) {
+                qc_lex();
+                if (QC_TOK(qc_token) == QC_FINISHED)
+                        break;
+                if (isname && QC_ISASGN_OP(qc_token))
+                        return 1;
+                isname = QC_TOK(qc_token) == QC_IDENTIFIER
+                         && !strcmp(qc_token_string, name);
+                if (isname && (isdecl || prev == QC_PLUSPLUS
+                               || prev == QC_MINUSMINUS
+                               || prev == QC_ANDTOK)) {
+                        return 1;
+                }
+                /* A local of the same name would hide `name' */
+                if (QC_ISTYPE(qc_token))
+                        isdecl = 1;
+                else if (QC_TOK(qc_token) == QC_SEMI)
+                        isdecl = 0;
+                prev = QC_TOK(qc_token);
+        }
+        return 0;
+}
+
+/*
+ * Decide whether the `for' loop whose header starts at the program
+ * counter has a simple induction variable with a literal range. The
+ * result is cached, so the header and body are scanned only once.
+ * The program counter is left where it was found.
+ */
+static struct qc_loop_t *loop_analyze(void)
+{
+        struct qc_program_t save;
+        struct qc_loop_t *l;
+        char *pc = qc_program_counter;
+        int op, step;
+
+        l = &loop_cache[((unsigned long)pc >> 2) % QC_LOOP_CACHE];
+        if (l->l_pc == pc)
+                return l;
+
+        l->l_pc = pc;
+        l->l_canon = 0;
+        qc_program_save(&save);
+
+        /* `(' IDENT `=' NUMBER `;' */
+        if (QC_TOK(qc_lex()) != QC_OPENPAREN
+            || QC_TOK(qc_lex()) != QC_IDENTIFIER)
+                goto done;
+        strcpy(l->l_name, qc_token_string);
+        if (QC_TOK(qc_lex()) != QC_EQEQ)
+                goto done;
+        qc_lex();
+        if (!loop_literal(&l->l_lo) || QC_TOK(qc_lex()) != QC_SEMI)
+                goto done;
+
+        /* IDENT (`<' | `<=') NUMBER `;' */
+        if (QC_TOK(qc_lex()) != QC_IDENTIFIER
+            || strcmp(qc_token_string, l->l_name))
+                goto done;
+        op = QC_TOK(qc_lex());
+        if (op != QC_LT && op != QC_LE)
+                goto done;
+        qc_lex();
+        if (!loop_literal(&l->l_hi) || QC_TOK(qc_lex()) != QC_SEMI)
+                goto done;
+        if (op == QC_LE) {
+                if (l->l_hi == 0x7FFFFFFF)
+                        goto done;
+                ++l->l_hi;
+        }
+
+        /* `++' IDENT | IDENT `++' | IDENT `+=' 1 */
+        qc_lex();
+        if (QC_TOK(qc_token) == QC_PLUSPLUS) {
+                if (QC_TOK(qc_lex()) != QC_IDENTIFIER
+                    || strcmp(qc_token_string, l->l_name))
+                        goto done;
+        } else if (QC_TOK(qc_token) == QC_IDENTIFIER
+                   && !strcmp(qc_token_string, l->l_name)) {
+                qc_lex();
+                if (QC_TOK(qc_token) == QC_PLUSEQ) {
+                        qc_lex();
+                        if (!loop_literal(&step) || step != 1)
+                                goto done;
+                } else if (QC_TOK(qc_token) != QC_PLUSPLUS) {
+                        goto done;
+                }
+        } else {
+                goto done;
+        }
+        if (QC_TOK(qc_lex()) != QC_CLOSEPAREN)
+                goto done;
+
+        l->l_canon = !loop_body_writes(l->l_name);
+done:
+        qc_program_restore(&save);
+        return l;
+}
+
+/*
+ * Push the range of a running loop's induction variable, if the loop
+ * was proven canonical by loop_analyze(). Return true if pushed.
+ */
+static int loop_range_push(struct qc_loop_t *l)
+{
+        struct qc_loop_range_t *r;
+        Variable *v;
+
+        if (!l->l_canon || loop_range_tos == FOR_NEST)
+                return 0;
+
+        /* Only a local variable whose address has never been taken is
+         * safe from being changed by a function called from the body.
+         * A `static' one is not in the frame, and is shared with
+         * recursive calls. */
+        v = qc_local_uvar_lookup(l->l_name);
+        if (v == NULL || QC_ISARRAY(v) || QC_TYPEOF(v->v_type) != QC_INT
+            || (v->v_flag & QC_VFLAG_ADDRTAKEN) != 0
+            || !qc_lvar_inframe(v))
+                return 0;
+
+        r = &loop_range_stack[loop_range_tos++];
+        r->r_var   = v;
+        r->r_lo    = l->l_lo;
+        r->r_hi    = l->l_hi;
+        r->r_nwalk = 0;
+        return 1;
+}
+
+/*
+ * Step the induction variable of the innermost running loop. This
+ * replaces evaluating the loop's `++i' expression, and walks every
+ * array element indexed by `i' forward by one element.
+ */
+static void loop_range_step(void)
+{
+        struct qc_loop_range_t *r;
+        struct qc_loop_walk_t *w;
+
+        r = &loop_range_stack[loop_range_tos - 1];
+        ++r->r_var->v_value.i;
+        for (w = &r->r_walk[0]; w < &r->r_walk[r->r_nwalk]; ++w)
+                w->w_elem += qc_type_size(w->w_array->v_type);
+}
+
+/**
+ * qc_loop_walker - Find the address of the array element at an index
+ * expression already being walked by a running loop.
+ * @site: Location of the index expression, just after the `['
+ * @array: The array being indexed
+ *
+ * Only loops started by the running function are searched.
+ *
+ * Return: The array element, or NULL if there is no walker for @site.
+ * If found, the program counter is moved past the closing `]'.
+ */
+void *qc_loop_walker(const char *site, Variable *array)
+{
+        struct qc_loop_range_t *r;
+        struct qc_loop_walk_t *w;
+
+        for (r = &loop_range_stack[loop_range_tos - 1];
+             r >= loop_range_stack && qc_lvar_inframe(r->r_var); --r) {
+                for (w = &r->r_walk[0]; w < &r->r_walk[r->r_nwalk]; ++w) {
+                        if (w->w_site == site && w->w_array == array) {
+                                qc_program_counter = w->w_end;
+                                return w->w_elem;
+                        }
+                }
+        }
+        return NULL;
+}
+
+/**
+ * qc_loop_walker_add - Start walking an array element.
+ * @site: Location of the index expression, just after the `['
+ * @end: Location just past the closing `]'
+ * @array: The array being indexed
+ * @iv: The index, which qc_loop_index_inbounds() has approved
+ * @elem: Address of the array element @iv currently points at
+ */
+void qc_loop_walker_add(char *site, char *end, Variable *array,
+                        Variable *iv, void *elem)
+{
+        struct qc_loop_range_t *r;
+        struct qc_loop_walk_t *w;
+
+        for (r = &loop_range_stack[loop_range_tos - 1];
+             r >= loop_range_stack; --r) {
+                if (r->r_var == iv)
+                        break;
+        }
+        if (r < loop_range_stack || r->r_nwalk == QC_LOOP_WALKERS)
+                return;
+
+        w = &r->r_walk[r->r_nwalk++];
+        w->w_site  = site;
+        w->w_end   = end;
+        w->w_array = array;
+        w->w_elem  = elem;
+}
+
+/**
+ * qc_loop_index_inbounds - Check if an array index is known to be in
+ * range without looking at its value.
+ * @iv: Variable used as the array index, or NULL if the index is an
+ *      expression.
+ * @size: Size of the array being indexed.
+ *
+ * Return: true if @iv is the induction variable of a running `for' loop,
+ * and every value it will take while that loop runs is a valid index
+ * into an array of @size elements.
+ */
+int qc_loop_index_inbounds(Variable *iv, size_t size)
+{
+        struct qc_loop_range_t *r;
+
+        if (iv == NULL)
+                return 0;
+
+        for (r = &loop_range_stack[loop_range_tos - 1];
+             r >= loop_range_stack; --r) {
+                if (r->r_var == iv)
+                        return r->r_lo >= 0 && (size_t)r->r_hi <= size;
+        }
+        return 0;
+}
+
 #define GET_SEMI_EXPRESSION(a, s)            \
 do {                                         \
         qcexpression(a);                     \
@@ -632,6 +1066,39 @@ do {                                         \
         qc_program_save(s);                  \
 } while (0)
 
+/*
+ * Helper to exec_for(). Run the body of a loop proven canonical by
+ * loop_analyze() `trips' times, without evaluating the loop's condition
+ * or iterator on each pass. Nothing but loop_range_step() changes the
+ * induction variable (see loop_range_push()), so the condition holds
+ * for exactly that many passes, and is not checked at all.
+ *
+ * The program counter is just past the first `;' of the loop header. On
+ * return, it is at the start of the body.
+ *
+ * Return value: Same as qc_interpret_block().
+ */
+static int exec_for_unrolled(int trips)
+{
+        char *body;
+        int ret = 0;
+
+        /* Skip the condition and iterator to the body, once. */
+        qcputback();
+        find_closing_paren();
+        body = qc_program_counter;
+
+        for (; trips > 0; --trips) {
+                qc_program_counter = body;
+                ret = qc_interpret_block();
+                if (ret)
+                        break;
+                loop_range_step();
+        }
+        qc_program_counter = body;
+        return ret;
+}
+
 /* Execute a for loop */
 static int exec_for(void)
 {
@@ -639,13 +1106,27 @@ static int exec_for(void)
          * necessary here. Try using `char *' instead. */
         Atom cond;
         struct qc_program_t iterator, truthstmt;
+        struct qc_loop_t *l;
+        long long trips;
         int ret = 0;
+        int pushed;
         char *progsave;
 
+        l = loop_analyze();
+        pushed = loop_range_push(l);
+
         qc_lex();
 
         GET_SEMI_EXPRESSION(&cond, &iterator);
 
+        /* Fixed, small trip count. The bounds are any two ints, so
+         * their difference may not fit in one. */
+        trips = (long long)l->l_hi - l->l_lo;
+        if (pushed && trips <= QC_UNROLL_MAX) {
+                ret = exec_for_unrolled(trips > 0 ? (int)trips : 0);
+                goto breakfromloop;
+        }
+
         for (;;) {
                 GET_SEMI_EXPRESSION(&cond, &truthstmt);
 
@@ -666,13 +1147,19 @@ static int exec_for(void)
                 } else {
                         goto breakfromloop;
                 }
-                qc_program_restore(&truthstmt);
-                qcexpression(&cond);
+                if (pushed) {
+                        loop_range_step();
+                } else {
+                        qc_program_restore(&truthstmt);
+                        qcexpression(&cond);
+                }
                 qc_program_restore(&iterator);
         }
         return 0;
 
 breakfromloop:
+        if (pushed)
+                --loop_range_tos;
         find_eob();
         return ret;
 }
@@ -694,19 +1181,16 @@ static int qc_namespace_init(Namespace *namespace)
  */
 static void qc_namespace_exit(Namespace *namespace)
 {
-        /* ustrings are managed in this file. */
-        int i;
-        for (i = 0; i < namespace->n_ustrings; ++i) {
-                if (namespace->ustrings[i].s != NULL)
-                        free(namespace->ustrings[i].s);
-        }
-        memset(namespace->ustrings, 0, sizeof(namespace->ustrings));
-        namespace->n_ustrings = 0;
+        struct qc_arena_t arena;
 
-        if (namespace->filepath != NULL)
-                free((void *)namespace->filepath);
         qc_function_namespace_exit(namespace);
-        free(namespace);
+        qc_struct_namespace_exit(namespace);
+        qc_fold_namespace_exit(namespace);
+        qclib_namespace_exit(namespace);
+
+        /* Everything else, including the Namespace, is in the arena */
+        arena = namespace->arena;
+        qc_arena_free(&arena);
 }
 
 /*
@@ -719,8 +1203,12 @@ static void qc_cleanup(void)
                 ns2 = ns->list;
                 qc_namespace_exit(ns);
         }
+        /* Cached loops point into the program buffers just freed */
+        memset(loop_cache, 0, sizeof(loop_cache));
+        loop_range_tos = 0;
         qclib_exit();
         qc_function_exit();
+        qc_struct_exit();
 }
 
 /**
@@ -736,12 +1224,14 @@ void qc_exit(int ret)
 
 /**
  * @brief Initialize QC variables. Called at start of vmebr.
+ * @param cfg Run-time limits, or NULL for the defaults.
  */
-int qc_init(void)
+int qc_init(const struct qc_config_t *cfg)
 {
+        memset(&qc_stats, 0, sizeof(qc_stats));
         qc_init_parser();
         qclib_init();
-        return qc_function_init();
+        return qc_function_init(cfg);
 }
 
 /**
@@ -753,20 +1243,25 @@ int qc_init(void)
 int qc_load_file(const char *fname)
 {
         Namespace *ns;
+        struct qc_arena_t arena;
         FILE *fp;
+        long size;
         int ret;
         Atom initret;
 
-        ns = malloc(sizeof(Namespace));
+        /* The Namespace is the first thing in its own arena */
+        memset(&arena, 0, sizeof(arena));
+        ns = qc_arena_alloc(&arena, sizeof(Namespace));
         if (ns == NULL) {
                 ret = -1;
                 goto errmalloc;
         }
+        ns->arena = arena;
 
         qc_namespace_init(ns);
 
         /* TODO: It may be better to use only the namespace name */
-        ns->filepath = strdup(fname);
+        ns->filepath = qc_arena_strdup(&ns->arena, fname);
 
         fp = fopen(fname, "rb");
         if (fp == NULL) {
@@ -774,27 +1269,43 @@ int qc_load_file(const char *fname)
                 goto errfopen;
         }
 
-        ret = load_program(fp, ns);
-        if (ret)
+        /* The program buffer is never longer than the file. Leave room
+         * for load_program() to write the EOF it stops at, and then a
+         * nul char over it. */
+        if (fseek(fp, 0L, SEEK_END) || (size = ftell(fp)) < 0
+            || fseek(fp, 0L, SEEK_SET)) {
+                ret = -1;
+                goto errload;
+        }
+        ns->program_buffer = qc_arena_alloc(&ns->arena, size + 2);
+        if (ns->program_buffer == NULL) {
+                ret = -QCE_NOMEM;
                 goto errload;
+        }
+
+        /* load_program() closes fp */
+        ret = load_program(fp, ns, size + 1);
+        if (ret)
+                goto errfopen;
 
         qc_program_counter = ns->program_buffer;
 
         /* Global namespace needs to be set before call to prescan */
         qc_namespace = ns;
         ret = prescan();
-        if (ret)
-                goto errprescan;
+        if (ret) {
+                /* prescan() already freed everything, including ns */
+                goto done;
+        }
 
         qc_execute("__init__", &initret, &initret, 0);
         goto done;
 
-errprescan:
-        /* TODO: namespace cleanup of ustrings */
 errload:
         fclose(fp);
 errfopen:
-        free(ns);
+        qc_namespace_list = ns->list;
+        qc_namespace_exit(ns);
 errmalloc:
 done:
         qc_namespace = NULL;
@@ -815,6 +1326,7 @@ int qc_execute(const char *funcname, Atom *ret, Atom args[], int nargs)
 
         switch (setjmp(qc_jmp_buf)) {
         case 0:
+                loop_range_tos = 0;
                 qc_program_counter = f->f_fn.u - 1;
                 strcpy(qc_token_string_buffer, funcname);
                 qc_token_string = &qc_token_string_buffer[0];
@@ -842,21 +1354,83 @@ int qc_execute(const char *funcname, Atom *ret, Atom args[], int nargs)
         return status;
 }
 
+/**
+ * @brief Get a copy of the run-time statistics gathered since qc_init().
+ */
+void qc_get_stats(struct qc_stats_t *st)
+{
+        memcpy(st, &qc_stats, sizeof(*st));
+}
+
+/**
+ * @brief Get a copy of the heap statistics of loaded file @fname.
+ *
+ * Return: zero, or -1 if @fname is not loaded.
+ */
+int qc_get_heap_stats(const char *fname, struct qc_heap_stats_t *st)
+{
+        Namespace *ns;
+
+        for (ns = qc_namespace_list; ns != NULL; ns = ns->list) {
+                if (!strcmp(ns->filepath, fname)) {
+                        memcpy(st, &ns->heap.h_stats, sizeof(*st));
+                        return 0;
+                }
+        }
+        return -1;
+}
+
+/**
+ * @brief Print the run-time statistics to @fp, with the heap statistics
+ * of each file that is still loaded.
+ */
+void qc_print_stats(FILE *fp)
+{
+        unsigned long total = qc_stats.s_int_fast + qc_stats.s_int_slow;
+        struct qc_heap_stats_t *hs;
+        Namespace *ns;
+
+        fprintf(fp, "int fast path: %lu hit, %lu miss (%lu%%)\n",
+                qc_stats.s_int_fast, qc_stats.s_int_slow,
+                total ? qc_stats.s_int_fast * 100 / total : 0);
+        fprintf(fp, "const reads folded: %lu\n", qc_stats.s_const_fold);
+        fprintf(fp, "pure calls: %lu remembered, %lu run\n",
+                qc_stats.s_memo_hit, qc_stats.s_memo_miss);
+
+        for (ns = qc_namespace_list; ns != NULL; ns = ns->list) {
+                hs = &ns->heap.h_stats;
+                fprintf(fp, "%s heap: %lu alloc, %lu free, "
+                        "%zu bytes in use (peak %zu), %lu big, "
+                        "%zu bytes pooled\n",
+                        ns->filepath, hs->hs_nalloc, hs->hs_nfree,
+                        hs->hs_inuse, hs->hs_peak, hs->hs_nbig,
+                        hs->hs_pooled);
+        }
+}
+
 int main(int argc, char **argv)
 {
         int ret;
+        int stats = 0;
         Atom mainret;
 
+        if (argc == 3 && !strcmp(argv[1], "-s")) {
+                stats = 1;
+                --argc;
+                ++argv;
+        }
         if (argc != 2) {
-                fprintf(stderr, "Usage: %s filename\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-s] filename\n", argv[0]);
                 return 1;
         }
 
-        qc_init();
+        qc_init(NULL);
         ret = qc_load_file(argv[1]);
         if (ret)
                 return ret;
         ret = qc_execute("main", &mainret, &mainret, 0);
+        if (stats)
+                qc_print_stats(stderr);
         if (!ret)
                 qc_cleanup();
         return ret;
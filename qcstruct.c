@@ -0,0 +1,323 @@
+/*
+ * Struct types.
+ *
+ * A struct's members are laid out in the order they are declared, each
+ * at the next offset that suits its alignment, the same way the C
+ * compiler lays out its own structs on this machine. So a struct, or an
+ * array of them, is one contiguous block, and every member is at a fixed
+ * offset from the start of its struct.
+ *
+ * Struct types are numbered in the order they are declared, and the
+ * number is kept in the high bits of their type token (see
+ * QC_STRUCTID()). So an Atom or Variable of a struct type, or of a
+ * pointer to one, knows its struct without a lookup by name.
+ */
+#include "qc.h"
+#include "qc_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Table of all loaded struct types, by number. Slot zero is not used,
+ * and a slot is NULL again once its Namespace exits.
+ */
+struct qc_struct_t **qc_struct_tbl = NULL;
+static unsigned int qc_struct_max = 0;
+
+/*
+ * struct qc_member_cache_t - A member access whose name was resolved
+ * @mc_site: Location of the member name in the program buffer, or
+ *      rather of the space before it, just past the `.' or `->'
+ * @mc_end: Location just past the member name
+ * @mc_id: Number of the struct type it was resolved for
+ * @mc_field: The member
+ *
+ * The next time the parser gets to @mc_site with the same struct, it
+ * skips to @mc_end with the member in hand, instead of reading the name
+ * and searching the struct for it.
+ */
+struct qc_member_cache_t {
+        const char *mc_site;
+        char *mc_end;
+        unsigned int mc_id;
+        const struct qc_field_t *mc_field;
+};
+static struct qc_member_cache_t member_cache[QC_MEMBER_CACHE];
+
+/*
+ * Get a free number for a new struct type.
+ */
+static unsigned int struct_number(void)
+{
+        struct qc_struct_t **tbl;
+        unsigned int i, n;
+
+        for (i = 1; i < qc_struct_max; ++i) {
+                if (qc_struct_tbl[i] == NULL)
+                        return i;
+        }
+
+        n = qc_struct_max == 0 ? 16 : qc_struct_max * 2;
+        if (n - 1 > QC_STRUCTID(~0U))
+                n = QC_STRUCTID(~0U) + 1;
+        if (n <= qc_struct_max)
+                qcsyntax(QCE_NOMEM);
+        tbl = realloc(qc_struct_tbl, n * sizeof(*tbl));
+        if (tbl == NULL)
+                qcsyntax(QCE_NOMEM);
+        memset(&tbl[qc_struct_max], 0, (n - qc_struct_max) * sizeof(*tbl));
+        qc_struct_tbl = tbl;
+        i = qc_struct_max == 0 ? 1 : qc_struct_max;
+        qc_struct_max = n;
+        return i;
+}
+
+/*
+ * Helper to qc_struct_declare(). Count the members of the struct whose
+ * body starts at the program counter, which is left where it was found.
+ * Every member declarator ends with either a comma or a semicolon.
+ */
+static int struct_count_fields(void)
+{
+        char *pc = qc_program_counter;
+        int n = 0;
+
+        for (;;) {
+                qc_lex();
+                switch (QC_TOK(qc_token)) {
+                case QC_COMMA:
+                case QC_SEMI:
+                        ++n;
+                        break;
+                case QC_CLOSEBR:
+                        goto done;
+                case QC_OPENBR:
+                case QC_FINISHED:
+                        qcsyntax(QCE_UNBAL_BRACES);
+                        break;
+                }
+        }
+done:
+        qc_program_counter = pc;
+        return n;
+}
+
+/*
+ * Helper to qc_struct_declare(). Add a member of type `type' to `st'.
+ * The current token is the member's name.
+ */
+static void struct_add_field(struct qc_struct_t *st, qctoken_t type)
+{
+        struct qc_field_t *f;
+        unsigned long long asize;
+        size_t align;
+        int i;
+
+        if (QC_TOK(qc_token) != QC_IDENTIFIER)
+                qcsyntax(QCE_IDENTIFIER_EXPECTED);
+        for (i = 0; i < st->st_nfield; ++i) {
+                if (!strcmp(st->st_field[i].f_name, qc_token_string))
+                        qcsyntax(QCE_NAMES_MATCH);
+        }
+
+        f = &st->st_field[st->st_nfield++];
+        strcpy(f->f_name, qc_token_string);
+        f->f_type = type;
+        f->f_asize = 0;
+
+        qc_lex();
+        if (QC_TOK(qc_token) == QC_OPENSQU) {
+                qc_lex();
+                if (QC_TOK(qc_token) != QC_NUMBER)
+                        qcsyntax(QCE_ARRAYSIZE_NOT_LIT);
+                asize = strtoull(qc_token_string, NULL, 0);
+                if (asize == 0 || asize > QC_GARRAY_MAX)
+                        qcsyntax(QCE_ARRAY_TOO_BIG);
+                qc_lex();
+                if (QC_TOK(qc_token) != QC_CLOSESQU)
+                        qcsyntax(QCE_SQUBRACE_EXPECTED);
+                qc_lex();
+                f->f_asize = asize;
+        }
+
+        align = qc_type_align(type);
+        if (align > st->st_align)
+                st->st_align = align;
+        f->f_offset = (st->st_size + align - 1) & ~(align - 1);
+        st->st_size = f->f_offset + qc_type_size(type)
+                      * (f->f_asize != 0 ? f->f_asize : 1);
+}
+
+/**
+ * qc_struct_declare - Declare a struct type. Part of prescan.
+ *
+ * The program counter is at the start of the declaration,
+ * `struct tag { members };'. A member may be of any type declared
+ * before the struct, including other structs, or be a pointer to the
+ * struct itself.
+ */
+void qc_struct_declare(void)
+{
+        Namespace *ns = qc_namespace;
+        struct qc_struct_t *st;
+        qctoken_t type, ftype;
+        unsigned int id;
+        hash_t hash;
+        int n;
+
+        qc_lex();
+        /* Struct tags have file scope anyway */
+        if (QC_ISSTATIC(qc_token))
+                qc_lex();
+        qc_lex();
+        if (QC_TOK(qc_token) != QC_IDENTIFIER)
+                qcsyntax(QCE_IDENTIFIER_EXPECTED);
+        hash = qc_symbol_hash(qc_token_string);
+        if (qc_symtab_lookup(&ns->struct_tab, qc_token_string, hash) != NULL)
+                qcsyntax(QCE_NAMES_MATCH);
+
+        st = qc_arena_alloc(&ns->arena, sizeof(*st));
+        if (st == NULL)
+                qcsyntax(QCE_NOMEM);
+        strcpy(st->st_name, qc_token_string);
+        st->st_ns = ns;
+        st->st_align = 1;
+
+        if (QC_TOK(qc_lex()) != QC_OPENBR)
+                qcsyntax(QCE_SYNTAX);
+        n = struct_count_fields();
+        if (n == 0)
+                qcsyntax(QCE_TYPE_EXPECTED);
+        st->st_field = qc_arena_alloc(&ns->arena, n * sizeof(*st->st_field));
+        if (st->st_field == NULL)
+                qcsyntax(QCE_NOMEM);
+
+        /* Enter it before reading the members, which may point to it */
+        id = struct_number();
+        st->st_type = QC_STRUCT | QC_STFLG | QC_TYPE
+                      | (id << QC_STRUCT_SHIFT);
+        if (qc_symtab_insert(&ns->struct_tab, st->st_name, hash, st))
+                qcsyntax(QCE_NOMEM);
+        qc_struct_tbl[id] = st;
+
+        for (;;) {
+                type = qc_get_type();
+                if (QC_TOK(qc_token) == QC_CLOSEBR)
+                        break;
+                if (!QC_ISTYPE(type) || type == (qctoken_t)-1
+                    || QC_ISSTATIC(type))
+                        qcsyntax(QCE_TYPE_EXPECTED);
+                /* Only whole variables are read-only, not members */
+                type &= ~QC_CONST;
+                do {
+                        ftype = type;
+                        qc_lex();
+                        if (QC_TOK(qc_token) == QC_MULTOK) {
+                                ftype |= QC_PTR;
+                                qc_lex();
+                        } else if (QC_ISVOID(ftype)
+                                   || QC_TYPEOF(ftype)
+                                      == QC_TYPEOF(st->st_type)) {
+                                /* Incomplete type */
+                                qcsyntax(QCE_TYPE_INVAL);
+                        }
+                        struct_add_field(st, ftype);
+                } while (QC_TOK(qc_token) == QC_COMMA);
+                if (QC_TOK(qc_token) != QC_SEMI)
+                        qcsyntax(QCE_SEMI_EXPECTED);
+        }
+
+        st->st_size = (st->st_size + st->st_align - 1) & ~(st->st_align - 1);
+        if (QC_TOK(qc_lex()) != QC_SEMI)
+                qcsyntax(QCE_SEMI_EXPECTED);
+}
+
+/**
+ * qc_struct_type - Get the type of a struct by its tag.
+ * @tag: The struct's tag
+ *
+ * Return: The struct's type, or zero if the current Namespace has not
+ * declared a struct named @tag.
+ */
+qctoken_t qc_struct_type(const char *tag)
+{
+        struct qc_struct_t *st;
+
+        st = qc_symtab_lookup(&qc_namespace->struct_tab, tag,
+                              qc_symbol_hash(tag));
+        return st != NULL ? st->st_type : 0;
+}
+
+/**
+ * qc_struct_member - Resolve a member access, `s.x' or `p->x'.
+ * @type: Type of the struct, or the pointer to it
+ *
+ * The program counter is just past the `.' or `->'. On return, it is
+ * past the member name, and the token after that has been read.
+ *
+ * Return: The member
+ */
+const struct qc_field_t *qc_struct_member(qctoken_t type)
+{
+        struct qc_member_cache_t *mc;
+        const struct qc_struct_t *st;
+        const struct qc_field_t *f;
+        char *site = qc_program_counter;
+        unsigned int id = QC_STRUCTID(type);
+        int i;
+
+        mc = &member_cache[((unsigned long)site >> 2) % QC_MEMBER_CACHE];
+        if (mc->mc_site == site && mc->mc_id == id) {
+                qc_program_counter = mc->mc_end;
+                qc_lex();
+                return mc->mc_field;
+        }
+
+        qc_lex();
+        if (QC_TOK(qc_token) != QC_IDENTIFIER)
+                qcsyntax(QCE_IDENTIFIER_EXPECTED);
+        st = qc_struct_tbl[id];
+        for (i = 0, f = st->st_field; i < st->st_nfield; ++i, ++f) {
+                if (!strcmp(f->f_name, qc_token_string))
+                        goto found;
+        }
+        qcsyntax(QCE_NO_MEMBER);
+
+found:
+        mc->mc_site  = site;
+        mc->mc_end   = qc_program_counter;
+        mc->mc_id    = id;
+        mc->mc_field = f;
+        qc_lex();
+        return f;
+}
+
+/**
+ * qc_struct_namespace_exit - Clean up everything in qcstruct.c that
+ * needs to be cleaned up before destroying a Namespace.
+ * @ns: Pointer to the Namespace to clean up.
+ */
+void qc_struct_namespace_exit(Namespace *ns)
+{
+        unsigned int i;
+
+        /* The structs themselves are freed with the Namespace's arena */
+        for (i = 1; i < qc_struct_max; ++i) {
+                if (qc_struct_tbl[i] != NULL && qc_struct_tbl[i]->st_ns == ns)
+                        qc_struct_tbl[i] = NULL;
+        }
+        qc_symtab_free(&ns->struct_tab);
+
+        /* Their numbers, and the program buffer, may be used again */
+        memset(member_cache, 0, sizeof(member_cache));
+}
+
+/**
+ * qc_struct_exit - Clean up everything in qcstruct.c before exiting.
+ */
+void qc_struct_exit(void)
+{
+        free(qc_struct_tbl);
+        qc_struct_tbl = NULL;
+        qc_struct_max = 0;
+}
@@ -78,7 +78,7 @@ void mkchar(void)
                                 printf("QCB_");
                                 next = 1;
                         }
-                        if (strchr(" !;,+-<>'/*%^=()\t\n&|[]{}", count)) {
+                        if (strchr(" !;,+-<>'/*%^=()\t\n&|[]{}.", count)) {
                                 if (next)
                                         printf(" | ");
                                 printf("QCD_");
@@ -153,6 +153,9 @@ void mktokx(void)
                         case ':':
                                 v = QC_COLON;
                                 break;
+                        case '.':
+                                v = QC_DOT;
+                                break;
                         case '*':
                                 v = QC_MULTOK;
                                 break;
@@ -0,0 +1,50 @@
+/*
+ * Program to report how much memory qc needs for each variable, now that
+ * a Variable is split into the part used to evaluate it and the part used
+ * to look it up, versus the old all-in-one Variable. Run `make sizes'.
+ */
+#include <stdio.h>
+#include "../qc.h"
+
+/*
+ * Variable as it was before the names were moved out of it, and before
+ * arrays were packed (when every element of a local array was one of
+ * these)
+ */
+struct old_variable {
+        char v_name[ID_LEN + 1];
+        unsigned char v_flag;
+        unsigned char v_aidx;
+        unsigned char v_asize;
+        Atom v_datum;
+        Atom *v_array;
+        hash_t v_hash;
+        struct old_variable *v_next;
+};
+
+#define CACHE_LINE 64
+
+int main(void)
+{
+        size_t old = sizeof(struct old_variable);
+        size_t hot = sizeof(Variable);
+        size_t lname = ID_LEN + 1;
+        /* Slots per global in a table that is QC_SYMTAB_LOAD percent full */
+        size_t gsym = sizeof(struct qc_symslot_t) * 100 / QC_SYMTAB_LOAD;
+
+        printf("Old Variable:                 %3zu bytes\n", old);
+        printf("New Variable (value, type):   %3zu bytes\n", hot);
+        printf("Local variable name:          %3zu bytes\n", lname);
+        printf("Hash table slots per global:  %3zu bytes\n", gsym);
+        printf("Local variable, total:        %3zu bytes (was %zu)\n",
+               hot + lname, old);
+        printf("Global variable, total:       %3zu bytes (was %zu)\n",
+               hot + lname + gsym, old);
+        printf("Variables per %d-byte cache line: %.1f (was %.1f)\n",
+               CACHE_LINE, (double)CACHE_LINE / hot,
+               (double)CACHE_LINE / old);
+        printf("Local names per %d-byte cache line: %.1f (was %.1f)\n",
+               CACHE_LINE, (double)CACHE_LINE / lname,
+               (double)CACHE_LINE / old);
+        return 0;
+}